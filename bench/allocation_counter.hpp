@@ -0,0 +1,11 @@
+// counts global operator new calls of the whole process, for allocation-per-operation reports
+
+#pragma once
+
+#include <cstdint>
+
+namespace allocation_counter {
+
+uint64_t allocations(); // operator new calls so far, all threads
+
+} // namespace allocation_counter
@@ -0,0 +1,660 @@
+// wrapper hot paths next to the same work done with raw sqlite3_* calls, on an in-memory and a file database;
+// every case reports C++ allocations per operation (allocs/op) and SQLite's peak heap growth (sqlite_peak_bytes),
+// imports and exports also their file throughput (bytes_per_second)
+
+#include "allocation_counter.hpp"
+#include "sqlite.hpp"
+
+#include <benchmark/benchmark.h>
+#include <sqlite3.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+namespace {
+
+enum Database { Memory = 0, File = 1 };
+
+constexpr int TableRows = 1000;
+
+std::string filePath() {
+    return "/tmp/sqlite_bench_" + std::to_string(getpid()) + ".db";
+}
+
+void removeFile() {
+    std::string path = filePath();
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+// t(id, name, score) with TableRows rows and an empty u for inserts; a file database runs in WAL mode with
+// synchronous = NORMAL, so commits are not each an fsync
+SQLite openDatabase(const benchmark::State& state) {
+    SQLite db;
+    if (state.range(0) == File) {
+        removeFile();
+        db.open(filePath(), SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create);
+        db.exec("PRAGMA journal_mode = WAL");
+        db.exec("PRAGMA synchronous = NORMAL");
+    } else {
+        db.open(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+    }
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT, score REAL)");
+    db.exec("CREATE TABLE u(id INTEGER, name TEXT, score REAL)");
+    db.exec("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c LIMIT " + std::to_string(TableRows) + ") "
+            "INSERT INTO t SELECT x, 'name ' || x, x * 0.5 FROM c");
+    return db;
+}
+
+void setLabel(benchmark::State& state) {
+    state.SetLabel(state.range(0) == File ? "file" : "memory");
+}
+
+// allocation counters over the benchmark loop, set when destroyed after it; an iteration is rowsPerIteration operations
+class Report {
+public:
+    explicit Report(benchmark::State& state, int rowsPerIteration = 1)
+        : state(state), rowsPerIteration(rowsPerIteration), allocations(allocation_counter::allocations()) {
+        setLabel(state);
+        sqlite3_memory_highwater(1);
+        baseline = sqlite3_memory_used();
+    }
+
+    ~Report() {
+        state.counters["allocs/op"] = benchmark::Counter(
+                static_cast<double>(allocation_counter::allocations() - allocations) / rowsPerIteration, benchmark::Counter::kAvgIterations);
+        state.counters["sqlite_peak_bytes"] = static_cast<double>(sqlite3_memory_highwater(0) - baseline);
+    }
+
+private:
+    benchmark::State& state;
+    int rowsPerIteration;
+    uint64_t allocations;
+    sqlite3_int64 baseline;
+};
+
+void check(int result, int expected) {
+    if (result != expected) {
+        std::fprintf(stderr, "unexpected SQLite result %d\n", result);
+        std::abort();
+    }
+}
+
+const char* selectSql = "SELECT id, name, score FROM t";
+const char* insertSql = "INSERT INTO u VALUES(?, ?, ?)";
+
+// prepare()
+
+void Prepare(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    Report report(state);
+    for (auto _ : state) {
+        auto statement = db.prepare(selectSql);
+        benchmark::DoNotOptimize(statement.handle());
+    }
+}
+
+void Prepare_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    Report report(state);
+    for (auto _ : state) {
+        sqlite3_stmt* stmt = nullptr;
+        check(sqlite3_prepare_v3(db.handle(), selectSql, -1, 0, &stmt, nullptr), SQLITE_OK);
+        benchmark::DoNotOptimize(stmt);
+        sqlite3_finalize(stmt);
+    }
+}
+
+// bind*()
+
+void Bind(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(insertSql);
+    std::string_view name = "a name that is longer than the small string buffer";
+    Report report(state);
+    for (auto _ : state) {
+        statement.bind(1, int64_t(42));
+        statement.bind(2, name);
+        statement.bind(3, 0.5);
+    }
+}
+
+void Bind_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(insertSql);
+    sqlite3_stmt* stmt = statement.handle();
+    std::string_view name = "a name that is longer than the small string buffer";
+    Report report(state);
+    for (auto _ : state) {
+        check(sqlite3_bind_int64(stmt, 1, 42), SQLITE_OK);
+        check(sqlite3_bind_text(stmt, 2, name.data(), static_cast<int>(name.size()), SQLITE_TRANSIENT), SQLITE_OK);
+        check(sqlite3_bind_double(stmt, 3, 0.5), SQLITE_OK);
+    }
+}
+
+void BindAll(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(insertSql);
+    std::string_view name = "a name that is longer than the small string buffer";
+    Report report(state);
+    for (auto _ : state) {
+        statement.bindAll(int64_t(42), name, 0.5);
+    }
+}
+
+// step(), per row
+
+void Step(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        while (statement.step()) {}
+        statement.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+void Step_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    sqlite3_stmt* stmt = statement.handle();
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {}
+        check(sqlite3_reset(stmt), SQLITE_OK);
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+// get*() by index and by name, per row
+
+void GetByIndex(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        while (statement.step()) {
+            benchmark::DoNotOptimize(statement.getInt64(0));
+            benchmark::DoNotOptimize(statement.getStringView(1));
+            benchmark::DoNotOptimize(statement.getDouble(2));
+        }
+        statement.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+void GetByName(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        while (statement.step()) {
+            benchmark::DoNotOptimize(statement.getInt64("id"));
+            benchmark::DoNotOptimize(statement.getStringView("name"));
+            benchmark::DoNotOptimize(statement.getDouble("score"));
+        }
+        statement.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+void GetByIndex_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    sqlite3_stmt* stmt = statement.handle();
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            benchmark::DoNotOptimize(sqlite3_column_int64(stmt, 0));
+            benchmark::DoNotOptimize(sqlite3_column_text(stmt, 1));
+            benchmark::DoNotOptimize(sqlite3_column_bytes(stmt, 1));
+            benchmark::DoNotOptimize(sqlite3_column_double(stmt, 2));
+        }
+        check(sqlite3_reset(stmt), SQLITE_OK);
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+// rows<>() / rowsAs<>() typed tuples and aggregates against the same sqlite3_column_* calls, per row
+
+struct Row {
+    int64_t id;
+    std::string_view name;
+    double score;
+};
+
+void Rows(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        for (const auto& row : statement.rows<int64_t, std::string_view, double>()) {
+            benchmark::DoNotOptimize(row);
+        }
+        statement.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+void RowsAs(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        for (const auto& row : statement.rowsAs<Row, int64_t, std::string_view, double>()) {
+            benchmark::DoNotOptimize(row);
+        }
+        statement.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+void Rows_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    sqlite3_stmt* stmt = statement.handle();
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const unsigned char* name = sqlite3_column_text(stmt, 1);
+            Row row{sqlite3_column_int64(stmt, 0),
+                    name ? std::string_view(reinterpret_cast<const char*>(name), sqlite3_column_bytes(stmt, 1)) : std::string_view(),
+                    sqlite3_column_double(stmt, 2)};
+            benchmark::DoNotOptimize(row);
+        }
+        check(sqlite3_reset(stmt), SQLITE_OK);
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+// by name in C: scan the column names for every access
+int rawColumnIndex(sqlite3_stmt* stmt, const char* name) {
+    int count = sqlite3_column_count(stmt);
+    for (int i = 0; i < count; ++i) {
+        if (std::strcmp(sqlite3_column_name(stmt, i), name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void GetByName_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    sqlite3_stmt* stmt = statement.handle();
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            benchmark::DoNotOptimize(sqlite3_column_int64(stmt, rawColumnIndex(stmt, "id")));
+            int name = rawColumnIndex(stmt, "name");
+            benchmark::DoNotOptimize(sqlite3_column_text(stmt, name));
+            benchmark::DoNotOptimize(sqlite3_column_bytes(stmt, name));
+            benchmark::DoNotOptimize(sqlite3_column_double(stmt, rawColumnIndex(stmt, "score")));
+        }
+        check(sqlite3_reset(stmt), SQLITE_OK);
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+// Column conversions, per row; the text column is converted to an owning std::string
+
+void ColumnConversion(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        while (statement.step()) {
+            int64_t id = statement[0];
+            std::string name = statement["name"];
+            double score = statement[2];
+            benchmark::DoNotOptimize(id);
+            benchmark::DoNotOptimize(name);
+            benchmark::DoNotOptimize(score);
+        }
+        statement.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+void ColumnConversion_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    sqlite3_stmt* stmt = statement.handle();
+    Report report(state, TableRows);
+    for (auto _ : state) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int64_t id = sqlite3_column_int64(stmt, 0);
+            auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            std::string name(text, sqlite3_column_bytes(stmt, 1));
+            double score = sqlite3_column_double(stmt, 2);
+            benchmark::DoNotOptimize(id);
+            benchmark::DoNotOptimize(name);
+            benchmark::DoNotOptimize(score);
+        }
+        check(sqlite3_reset(stmt), SQLITE_OK);
+    }
+    state.SetItemsProcessed(state.iterations() * TableRows);
+}
+
+// exec()
+
+const char* updateSql = "UPDATE t SET score = score + 1 WHERE id = 1";
+
+void Exec(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    Report report(state);
+    for (auto _ : state) {
+        db.exec(updateSql);
+    }
+}
+
+void Exec_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    Report report(state);
+    for (auto _ : state) {
+        check(sqlite3_exec(db.handle(), updateSql, nullptr, nullptr, nullptr), SQLITE_OK);
+    }
+}
+
+// bulk insert, per row; range(1) is 1 for one transaction per iteration, 0 for autocommit rows
+
+int bulkRows(const benchmark::State& state) {
+    return state.range(1) ? 1000 : 100;
+}
+
+// raw, so the reset between iterations adds no C++ allocations to the count
+void clearInserted(benchmark::State& state, SQLite& db) {
+    state.PauseTiming();
+    check(sqlite3_exec(db.handle(), "DELETE FROM u", nullptr, nullptr, nullptr), SQLITE_OK);
+    state.ResumeTiming();
+}
+
+void BulkInsert(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    SQLite::BulkInsertOptions options;
+    options.rowsPerTransaction = state.range(1) ? 1000000 : 0; // 0 leaves every row in its own autocommit
+    SQLite::BulkInserter inserter(db, "u", {"id", "name", "score"}, options);
+    std::string_view name = "a name that is longer than the small string buffer";
+    int rows = bulkRows(state);
+    Report report(state, rows);
+    for (auto _ : state) {
+        for (int i = 0; i < rows; ++i) {
+            inserter.insert(int64_t(i), name, i * 0.5);
+        }
+        inserter.flush();
+        clearInserted(state, db);
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+    state.SetLabel(std::string(state.range(0) == File ? "file" : "memory") + (state.range(1) ? ", transaction" : ", autocommit"));
+}
+
+void BulkInsert_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    sqlite3* handle = db.handle();
+    std::string_view name = "a name that is longer than the small string buffer";
+    sqlite3_stmt* stmt = nullptr;
+    check(sqlite3_prepare_v3(handle, insertSql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr), SQLITE_OK);
+    int rows = bulkRows(state);
+    {
+        Report report(state, rows);
+        for (auto _ : state) {
+            if (state.range(1)) {
+                check(sqlite3_exec(handle, "BEGIN", nullptr, nullptr, nullptr), SQLITE_OK);
+            }
+            for (int i = 0; i < rows; ++i) {
+                sqlite3_bind_int64(stmt, 1, i);
+                sqlite3_bind_text(stmt, 2, name.data(), static_cast<int>(name.size()), SQLITE_TRANSIENT);
+                sqlite3_bind_double(stmt, 3, i * 0.5);
+                check(sqlite3_step(stmt), SQLITE_DONE);
+                sqlite3_reset(stmt);
+            }
+            if (state.range(1)) {
+                check(sqlite3_exec(handle, "COMMIT", nullptr, nullptr, nullptr), SQLITE_OK);
+            }
+            clearInserted(state, db);
+        }
+    }
+    sqlite3_finalize(stmt);
+    state.SetItemsProcessed(state.iterations() * rows);
+    state.SetLabel(std::string(state.range(0) == File ? "file" : "memory") + (state.range(1) ? ", transaction" : ", autocommit"));
+}
+
+// import and export of CSV and JSON lines files, per row with file bytes per second from TransferStats
+
+constexpr int TransferRows = 10000;
+
+std::string transferPath(const char* extension) {
+    return "/tmp/sqlite_bench_" + std::to_string(getpid()) + "." + extension;
+}
+
+// id,name,score rows as in t, written once per process; the CSV has a header and no quoted fields
+const std::string& transferFile(bool json) {
+    static const std::string files[2] = {
+        [] {
+            std::string path = transferPath("csv");
+            FILE* file = std::fopen(path.c_str(), "wb");
+            std::fprintf(file, "id,name,score\n");
+            for (int i = 1; i <= TransferRows; ++i) {
+                std::fprintf(file, "%d,name %d,%g\n", i, i, i * 0.5);
+            }
+            std::fclose(file);
+            return path;
+        }(),
+        [] {
+            std::string path = transferPath("jsonl");
+            FILE* file = std::fopen(path.c_str(), "wb");
+            for (int i = 1; i <= TransferRows; ++i) {
+                std::fprintf(file, "{\"id\":%d,\"name\":\"name %d\",\"score\":%g}\n", i, i, i * 0.5);
+            }
+            std::fclose(file);
+            return path;
+        }(),
+    };
+    return files[json ? 1 : 0];
+}
+
+void removeTransferFiles() {
+    for (const char* extension : {"csv", "jsonl", "out.csv", "out.jsonl"}) {
+        std::remove(transferPath(extension).c_str());
+    }
+}
+
+void setTransferred(benchmark::State& state, uint64_t rows, uint64_t bytes) {
+    state.SetItemsProcessed(static_cast<int64_t>(rows));
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+
+void ImportCsv(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    const std::string& file = transferFile(false);
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    {
+        Report report(state, TransferRows);
+        for (auto _ : state) {
+            SQLite::TransferStats stats = db.importCsv(file, "u");
+            rows += stats.rows;
+            bytes += stats.bytes;
+            clearInserted(state, db);
+        }
+    }
+    setTransferred(state, rows, bytes);
+}
+
+void ImportJsonLines(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    const std::string& file = transferFile(true);
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    {
+        Report report(state, TransferRows);
+        for (auto _ : state) {
+            SQLite::TransferStats stats = db.importJsonLines(file, "u");
+            rows += stats.rows;
+            bytes += stats.bytes;
+            clearInserted(state, db);
+        }
+    }
+    setTransferred(state, rows, bytes);
+}
+
+// reads lines with fgets and splits them in place, as a minimal C importer for this file would
+void ImportCsv_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    sqlite3* handle = db.handle();
+    const std::string& path = transferFile(false);
+    sqlite3_stmt* stmt = nullptr;
+    check(sqlite3_prepare_v3(handle, insertSql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr), SQLITE_OK);
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    {
+        Report report(state, TransferRows);
+        for (auto _ : state) {
+            FILE* file = std::fopen(path.c_str(), "rb");
+            char line[256];
+            bytes += std::strlen(std::fgets(line, sizeof(line), file)); // header
+            check(sqlite3_exec(handle, "BEGIN", nullptr, nullptr, nullptr), SQLITE_OK);
+            while (std::fgets(line, sizeof(line), file)) {
+                size_t length = std::strlen(line);
+                bytes += length;
+                line[length - 1] = '\0';
+                char* name = std::strchr(line, ',');
+                *name++ = '\0';
+                char* score = std::strchr(name, ',');
+                *score++ = '\0';
+                sqlite3_bind_text(stmt, 1, line, static_cast<int>(name - line - 1), SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 2, name, static_cast<int>(score - name - 1), SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 3, score, -1, SQLITE_STATIC);
+                check(sqlite3_step(stmt), SQLITE_DONE);
+                sqlite3_reset(stmt);
+                ++rows;
+            }
+            check(sqlite3_exec(handle, "COMMIT", nullptr, nullptr, nullptr), SQLITE_OK);
+            std::fclose(file);
+            clearInserted(state, db);
+        }
+    }
+    sqlite3_finalize(stmt);
+    setTransferred(state, rows, bytes);
+}
+
+// t holds TableRows rows, exported in full every iteration
+void ExportCsv(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    std::string file = transferPath("out.csv");
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    {
+        Report report(state, TableRows);
+        for (auto _ : state) {
+            SQLite::TransferStats stats = SQLite::exportCsv(statement, file);
+            rows += stats.rows;
+            bytes += stats.bytes;
+        }
+    }
+    setTransferred(state, rows, bytes);
+}
+
+void ExportJsonLines(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    std::string file = transferPath("out.jsonl");
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    {
+        Report report(state, TableRows);
+        for (auto _ : state) {
+            SQLite::TransferStats stats = SQLite::exportJsonLines(statement, file);
+            rows += stats.rows;
+            bytes += stats.bytes;
+        }
+    }
+    setTransferred(state, rows, bytes);
+}
+
+// fprintf per row, without the CSV quoting the wrapper checks for
+void ExportCsv_Raw(benchmark::State& state) {
+    SQLite db = openDatabase(state);
+    auto statement = db.prepare(selectSql);
+    sqlite3_stmt* stmt = statement.handle();
+    std::string path = transferPath("out.csv");
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    {
+        Report report(state, TableRows);
+        for (auto _ : state) {
+            FILE* file = std::fopen(path.c_str(), "wb");
+            int written = std::fprintf(file, "id,name,score\n");
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                written += std::fprintf(file, "%lld,%s,%.17g\n", static_cast<long long>(sqlite3_column_int64(stmt, 0)),
+                        reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)), sqlite3_column_double(stmt, 2));
+                ++rows;
+            }
+            check(sqlite3_reset(stmt), SQLITE_OK);
+            std::fclose(file);
+            bytes += static_cast<uint64_t>(written);
+        }
+    }
+    setTransferred(state, rows, bytes);
+}
+
+void databases(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgName("file")->Arg(Memory)->Arg(File);
+}
+
+// imports parse on a second thread, so rates are taken over wall time
+void transferDatabases(benchmark::internal::Benchmark* benchmark) {
+    databases(benchmark);
+    benchmark->UseRealTime();
+}
+
+void bulkDatabases(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgNames({"file", "transaction"})->ArgsProduct({{Memory, File}, {1, 0}});
+}
+
+} // namespace
+
+BENCHMARK(Prepare)->Apply(databases);
+BENCHMARK(Prepare_Raw)->Apply(databases);
+BENCHMARK(Bind)->Apply(databases);
+BENCHMARK(BindAll)->Apply(databases);
+BENCHMARK(Bind_Raw)->Apply(databases);
+BENCHMARK(Step)->Apply(databases);
+BENCHMARK(Step_Raw)->Apply(databases);
+BENCHMARK(GetByIndex)->Apply(databases);
+BENCHMARK(GetByIndex_Raw)->Apply(databases);
+BENCHMARK(GetByName)->Apply(databases);
+BENCHMARK(GetByName_Raw)->Apply(databases);
+BENCHMARK(Rows)->Apply(databases);
+BENCHMARK(RowsAs)->Apply(databases);
+BENCHMARK(Rows_Raw)->Apply(databases);
+BENCHMARK(ColumnConversion)->Apply(databases);
+BENCHMARK(ColumnConversion_Raw)->Apply(databases);
+BENCHMARK(Exec)->Apply(databases);
+BENCHMARK(Exec_Raw)->Apply(databases);
+BENCHMARK(BulkInsert)->Apply(bulkDatabases);
+BENCHMARK(BulkInsert_Raw)->Apply(bulkDatabases);
+BENCHMARK(ImportCsv)->Apply(transferDatabases);
+BENCHMARK(ImportJsonLines)->Apply(transferDatabases);
+BENCHMARK(ImportCsv_Raw)->Apply(transferDatabases);
+BENCHMARK(ExportCsv)->Apply(transferDatabases);
+BENCHMARK(ExportJsonLines)->Apply(transferDatabases);
+BENCHMARK(ExportCsv_Raw)->Apply(transferDatabases);
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    removeFile();
+    removeTransferFiles();
+    return 0;
+}
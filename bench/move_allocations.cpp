@@ -0,0 +1,63 @@
+// checks that moving the wrapper value types and binding moved strings through bindAll perform no heap
+// allocations, exits non-zero and names the failed case otherwise
+
+#include "allocation_counter.hpp"
+#include "sqlite.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+// runs body and reports the operator new calls it made, expected none
+template<typename F>
+void expectNoAllocations(const char* name, F&& body) {
+    uint64_t before = allocation_counter::allocations();
+    body();
+    uint64_t count = allocation_counter::allocations() - before;
+    std::printf("%-28s %llu allocations\n", name, static_cast<unsigned long long>(count));
+    if (count != 0) {
+        failures++;
+    }
+}
+
+} // namespace
+
+int main() {
+    SQLite db(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+    db.exec("CREATE TABLE t(a, b, c)");
+
+    auto statement = db.prepare("SELECT a, b, c FROM t WHERE a = ? OR b = ? OR c = ?");
+    SQLite::Statement moved;
+    expectNoAllocations("Statement move", [&] { SQLite::Statement other(std::move(statement)); moved = std::move(other); });
+    expectNoAllocations("Statement move back", [&] { statement = std::move(moved); });
+
+    SQLite movedDb;
+    expectNoAllocations("SQLite move", [&] { SQLite other(std::move(db)); movedDb = std::move(other); });
+    db = std::move(movedDb);
+
+    auto cached = db.prepareCached("SELECT a FROM t WHERE a = ?");
+    SQLite::CachedStatement movedCached;
+    expectNoAllocations("CachedStatement move", [&] { SQLite::CachedStatement other(std::move(cached)); movedCached = std::move(other); });
+    cached = std::move(movedCached);
+
+    // strings longer than the small string buffer, created up front so only the binds are counted
+    constexpr int Binds = 10;
+    std::vector<std::string> values;
+    for (int i = 0; i < 3 * (Binds + 1); i++) {
+        values.push_back(std::string(64, static_cast<char>('a' + i % 26)));
+    }
+    statement.bindAll(std::move(values[0]), std::move(values[1]), std::move(values[2])); // sizes the owned bindings
+    expectNoAllocations("bindAll moved strings x10", [&] {
+        for (int i = 1; i <= Binds; i++) {
+            statement.bindAll(std::move(values[3 * i]), std::move(values[3 * i + 1]), std::move(values[3 * i + 2]));
+        }
+    });
+
+    return failures == 0 ? 0 : 1;
+}
@@ -2,6 +2,22 @@
 
 #include "sqlite.hpp"
 
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <cerrno>
+#include <cctype>
+#include <cstring>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 std::string to_string(SQLite::DataType type) {
     switch (type) {
@@ -31,6 +47,8 @@ void throwSQLiteError(sqlite3* db, const std::string& message, const std::string
     switch (code) {
         case SQLITE_BUSY:
             throw SQLite::BusyError(message, errmsg, code, extended_code);
+        case SQLITE_INTERRUPT:
+            throw SQLite::InterruptedError(message, errmsg, code, extended_code);
         case SQLITE_MISUSE:
             throw SQLite::MisuseError(message, errmsg, code, extended_code);
         default:
@@ -56,272 +74,4299 @@ std::unique_ptr<SQLite::Error> SQLite::configureSerialized() {
     return nullptr;
 }
 
-void SQLite::open(const std::string& dbName, OpenFlags flags) {
-    int sqliteFlags = toSQLiteOpenFlags(flags);
-    if (sqlite3_open_v2(dbName.c_str(), &db, sqliteFlags, nullptr) != SQLITE_OK) {
-        throwSQLiteError(db, "failed to open database");
+std::unique_ptr<SQLite::Error> SQLite::configurePageCache(void* buffer, int slotSize, int slotCount) {
+    int result = sqlite3_config(SQLITE_CONFIG_PAGECACHE, buffer, slotSize, slotCount);
+    if (result != SQLITE_OK) {
+        return std::make_unique<SQLite::Error>(
+            "failed to configure SQLite page cache",
+            sqlite3_errstr(result),
+            result,
+            result
+        );
     }
+    return nullptr;
 }
 
-void SQLite::close() {
-    if (db) {
-        if (sqlite3_close(db) != SQLITE_OK) {
-            throwSQLiteError(db, "failed to close connection");
-        }
-        db = nullptr;
+namespace {
+
+// SQLITE_CONFIG_MALLOC callbacks have no context argument, the resource is process-wide like the configuration
+std::pmr::memory_resource* mallocResource = nullptr;
+
+// SQLite needs the size of each allocation (xSize), kept in a header in front of the block
+constexpr size_t MallocHeader = 16; // also the alignment of the returned blocks, SQLite requires 8
+
+void* resourceMalloc(int size) {
+    size_t bytes = static_cast<size_t>(size) + MallocHeader;
+    try {
+        auto* block = static_cast<unsigned char*>(mallocResource->allocate(bytes, MallocHeader));
+        *reinterpret_cast<size_t*>(block) = static_cast<size_t>(size);
+        return block + MallocHeader;
+    } catch (const std::bad_alloc&) {
+        return nullptr;
     }
 }
 
-SQLite::~SQLite() {
-    close();
+int resourceSize(void* p) {
+    return static_cast<int>(*reinterpret_cast<size_t*>(static_cast<unsigned char*>(p) - MallocHeader));
 }
 
-int SQLite::toSQLiteOpenFlags(OpenFlags flags) {
-    int sqliteFlags = 0;
-
-    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::ReadOnly)) sqliteFlags |= SQLITE_OPEN_READONLY;
-    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::ReadWrite)) sqliteFlags |= SQLITE_OPEN_READWRITE;
-    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::Create)) sqliteFlags |= SQLITE_OPEN_CREATE;
-    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::URI)) sqliteFlags |= SQLITE_OPEN_URI;
-    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::Memory)) sqliteFlags |= SQLITE_OPEN_MEMORY;
-    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::NoMutex)) sqliteFlags |= SQLITE_OPEN_NOMUTEX;
-    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::FullMutex)) sqliteFlags |= SQLITE_OPEN_FULLMUTEX;
-    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::SharedCache)) sqliteFlags |= SQLITE_OPEN_SHAREDCACHE;
-    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::PrivateCache)) sqliteFlags |= SQLITE_OPEN_PRIVATECACHE;
-    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::NoFollow)) sqliteFlags |= SQLITE_OPEN_NOFOLLOW;
-
-    return sqliteFlags;
+void resourceFree(void* p) {
+    auto* block = static_cast<unsigned char*>(p) - MallocHeader;
+    mallocResource->deallocate(block, *reinterpret_cast<size_t*>(block) + MallocHeader, MallocHeader);
 }
 
-SQLite::Statement::Statement(sqlite3* db, const std::string& sql, bool persistent) {
-    int prepareFlags = persistent ? SQLITE_PREPARE_PERSISTENT : 0;
-    if (sqlite3_prepare_v3(db, sql.c_str(), -1, prepareFlags, &stmt, nullptr) != SQLITE_OK) {
-        throwSQLiteError(db, "failed to prepare statement", sql);
+void* resourceRealloc(void* p, int size) {
+    int oldSize = resourceSize(p);
+    if (size <= oldSize && size > oldSize / 2) {
+        return p; // shrinking a little, keep the block
+    }
+    void* resized = resourceMalloc(size);
+    if (resized) {
+        std::memcpy(resized, p, static_cast<size_t>(std::min(size, oldSize)));
+        resourceFree(p);
     }
-    initializeColumnIndices();
+    return resized;
 }
 
-SQLite::Statement::~Statement() {
-    finalize();
+int resourceRoundup(int size) {
+    return (size + 7) & ~7;
 }
 
-SQLite::Statement::Statement(Statement&& other) noexcept : stmt(other.stmt), columnIndices(other.columnIndices) {
-    other.stmt = nullptr;
+int resourceInit(void*) {
+    return SQLITE_OK;
 }
 
-SQLite::Statement& SQLite::Statement::operator=(Statement&& other) noexcept {
-    if (this != &other) {
-        finalize();
-        stmt = other.stmt;
-        other.stmt = nullptr;
+void resourceShutdown(void*) {}
+
+std::optional<sqlite3_mem_methods> defaultMalloc;
 
-        columnIndices = std::move(other.columnIndices);
+// size classes 16, 32, ... 4096 bytes, each thread keeps up to CachedBlocks freed blocks per class
+class ThreadCachingResource : public std::pmr::memory_resource {
+public:
+    static constexpr size_t Classes = 9;
+    static constexpr size_t MaxBlock = size_t(16) << (Classes - 1);
+    static constexpr size_t CachedBlocks = 64;
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        size_t sizeClass;
+        if (alignment > alignof(std::max_align_t) || !classOf(bytes, sizeClass)) {
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+        Cache& cache = threadCache();
+        if (Block* block = cache.heads[sizeClass]) {
+            cache.heads[sizeClass] = block->next;
+            --cache.counts[sizeClass];
+            return block;
+        }
+        return std::pmr::new_delete_resource()->allocate(size_t(16) << sizeClass, alignof(std::max_align_t));
     }
-    return *this;
-}
 
-void SQLite::Statement::finalize() {
-    if (stmt) {
-        if (sqlite3_finalize(stmt) != SQLITE_OK) {
-            throwSQLiteError(sqlite3_db_handle(stmt), "failed to finalize statement");
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        size_t sizeClass;
+        if (alignment > alignof(std::max_align_t) || !classOf(bytes, sizeClass)) {
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+            return;
         }
-        stmt = nullptr;
+        // blocks freed on another thread than they were allocated on join this thread's cache
+        Cache& cache = threadCache();
+        if (cache.counts[sizeClass] < CachedBlocks) {
+            auto* block = static_cast<Block*>(p);
+            block->next = cache.heads[sizeClass];
+            cache.heads[sizeClass] = block;
+            ++cache.counts[sizeClass];
+            return;
+        }
+        std::pmr::new_delete_resource()->deallocate(p, size_t(16) << sizeClass, alignof(std::max_align_t));
     }
-}
 
-void SQLite::Statement::initializeColumnIndices() {
-    int columnCount = sqlite3_column_count(stmt);
-    for (int i = 0; i < columnCount; ++i) {
-        const char* columnName = sqlite3_column_name(stmt, i);
-        if (columnName) {
-            columnIndices[columnName] = i;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    struct Block {
+        Block* next;
+    };
+
+    struct Cache {
+        std::array<Block*, Classes> heads{};
+        std::array<size_t, Classes> counts{};
+
+        ~Cache() {
+            for (size_t i = 0; i < Classes; ++i) {
+                while (Block* block = heads[i]) {
+                    heads[i] = block->next;
+                    std::pmr::new_delete_resource()->deallocate(block, size_t(16) << i, alignof(std::max_align_t));
+                }
+            }
         }
+    };
+
+    static Cache& threadCache() {
+        thread_local Cache cache;
+        return cache;
     }
-}
 
-int SQLite::Statement::getColumnIndex(const std::string& columnName) const {
-    auto it = columnIndices.find(columnName);
-    if (it != columnIndices.end()) {
-        return it->second;
+    static bool classOf(size_t bytes, size_t& sizeClass) {
+        if (bytes > MaxBlock) {
+            return false;
+        }
+        sizeClass = 0;
+        while ((size_t(16) << sizeClass) < bytes) {
+            ++sizeClass;
+        }
+        return true;
     }
-    throw SQLite::OtherError("column not found: " + columnName);
-}
+};
 
-int SQLite::Statement::getParamIndex(const std::string& paramName) const {
-    ensure();
-    int index = sqlite3_bind_parameter_index(stmt, paramName.c_str());
-    if (index == 0) {
-        throw SQLite::OtherError("parameter not found: " + paramName);
+std::atomic<std::pmr::memory_resource*> wrapperResource{nullptr};
+
+} // namespace
+
+std::unique_ptr<SQLite::Error> SQLite::configureMalloc(std::pmr::memory_resource* resource) {
+    if (!defaultMalloc) {
+        sqlite3_mem_methods methods;
+        if (sqlite3_config(SQLITE_CONFIG_GETMALLOC, &methods) == SQLITE_OK) {
+            defaultMalloc = methods;
+        }
     }
-    return index;
+    int result;
+    if (resource) {
+        static sqlite3_mem_methods methods = {
+            resourceMalloc, resourceFree, resourceRealloc, resourceSize, resourceRoundup, resourceInit, resourceShutdown, nullptr
+        };
+        std::pmr::memory_resource* previous = mallocResource;
+        mallocResource = resource;
+        result = sqlite3_config(SQLITE_CONFIG_MALLOC, &methods);
+        if (result != SQLITE_OK) {
+            mallocResource = previous;
+        }
+    } else if (defaultMalloc) {
+        result = sqlite3_config(SQLITE_CONFIG_MALLOC, &*defaultMalloc);
+    } else {
+        result = SQLITE_MISUSE;
+    }
+    if (result != SQLITE_OK) {
+        return std::make_unique<SQLite::Error>(
+            "failed to configure SQLite allocator",
+            sqlite3_errstr(result),
+            result,
+            result
+        );
+    }
+    return nullptr;
 }
 
-std::string SQLite::Statement::getParamName(int index) const {
-    ensure();
-    const char* name = sqlite3_bind_parameter_name(stmt, index);
-    if (name) {
-        return name;
-    }
-    return "";
+std::pmr::memory_resource* SQLite::threadCachingResource() {
+    static ThreadCachingResource resource;
+    return &resource;
 }
 
-void SQLite::Statement::bind(int index, int value) {
+void SQLite::setMemoryResource(std::pmr::memory_resource* resource) {
+    wrapperResource = resource;
+}
+
+std::pmr::memory_resource* SQLite::memoryResource() {
+    std::pmr::memory_resource* resource = wrapperResource;
+    return resource ? resource : std::pmr::get_default_resource();
+}
+
+SQLite::MemoryStats SQLite::memoryStats(bool resetHighwater) {
+    auto status = [resetHighwater](int op, int64_t* current, int64_t* highwater) {
+        sqlite3_int64 value = 0;
+        sqlite3_int64 peak = 0;
+        sqlite3_status64(op, &value, &peak, resetHighwater ? 1 : 0);
+        if (current) *current = value;
+        *highwater = peak;
+    };
+    MemoryStats stats;
+    status(SQLITE_STATUS_MEMORY_USED, &stats.used, &stats.usedHighwater);
+    status(SQLITE_STATUS_MALLOC_COUNT, &stats.allocations, &stats.allocationsHighwater);
+    status(SQLITE_STATUS_MALLOC_SIZE, nullptr, &stats.largestAllocation);
+    status(SQLITE_STATUS_PAGECACHE_USED, &stats.pageCacheUsed, &stats.pageCacheUsedHighwater);
+    status(SQLITE_STATUS_PAGECACHE_OVERFLOW, &stats.pageCacheOverflow, &stats.pageCacheOverflowHighwater);
+    return stats;
+}
+
+SQLite::ConnectionMemoryStats SQLite::connectionMemoryStats(bool resetHighwater) const {
     ensure();
-    if (sqlite3_bind_int(stmt, index, value) != SQLITE_OK) {
-        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind int");
+    ConnectionMemoryStats stats;
+    int highwater = 0;
+    int reset = resetHighwater ? 1 : 0;
+    sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_USED, &stats.cacheUsed, &highwater, 0);
+    sqlite3_db_status(db, SQLITE_DBSTATUS_SCHEMA_USED, &stats.schemaUsed, &highwater, 0);
+    sqlite3_db_status(db, SQLITE_DBSTATUS_STMT_USED, &stats.statementUsed, &highwater, 0);
+    sqlite3_db_status(db, SQLITE_DBSTATUS_LOOKASIDE_USED, &stats.lookasideUsed, &stats.lookasideHighwater, reset);
+    return stats;
+}
+
+std::unique_ptr<SQLite::Error> SQLite::configureLookaside(int slotSize, int slotCount) {
+    int result = sqlite3_config(SQLITE_CONFIG_LOOKASIDE, slotSize, slotCount);
+    if (result != SQLITE_OK) {
+        return std::make_unique<SQLite::Error>(
+            "failed to configure SQLite lookaside",
+            sqlite3_errstr(result),
+            result,
+            result
+        );
     }
+    return nullptr;
 }
 
-void SQLite::Statement::bind(int index, int64_t value) {
-    ensure();
-    if (sqlite3_bind_int64(stmt, index, value) != SQLITE_OK) {
-        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind int64");
+void SQLite::open(const std::string& dbName, OpenFlags flags) {
+    int sqliteFlags = toSQLiteOpenFlags(flags);
+    if (sqlite3_open_v2(dbName.c_str(), &db, sqliteFlags, nullptr) != SQLITE_OK) {
+        throwSQLiteError(db, "failed to open database");
+    }
+    if (busyHandler) {
+        sqlite3_busy_handler(db, busyCallback, busyHandler.get());
+    }
+    if (profiler) {
+        installTrace();
+    }
+    if (progress) {
+        sqlite3_progress_handler(db, progress->interval, progressCallback, progress.get());
+        setTokenConnection(db);
     }
 }
 
-void SQLite::Statement::bind(int index, double value) {
-    ensure();
-    if (sqlite3_bind_double(stmt, index, value) != SQLITE_OK) {
-        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind double");
+void SQLite::open(const std::string& dbName, OpenFlags flags, const OpenOptions& options) {
+    open(dbName, flags);
+    try {
+        applyOptions(options);
+    } catch (...) {
+        if (statementCache_) {
+            statementCache_->clear();
+        }
+        setTokenConnection(nullptr);
+        sqlite3_close_v2(db);
+        db = nullptr;
+        throw;
     }
 }
 
-void SQLite::Statement::bind(int index, const std::string& value) {
-    ensure();
-    if (sqlite3_bind_text(stmt, index, value.c_str(), value.size(), SQLITE_TRANSIENT) != SQLITE_OK) {
-        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind text");
+static const char* toPragmaValue(SQLite::JournalMode mode) {
+    switch (mode) {
+        case SQLite::JournalMode::Delete: return "delete";
+        case SQLite::JournalMode::Truncate: return "truncate";
+        case SQLite::JournalMode::Persist: return "persist";
+        case SQLite::JournalMode::Memory: return "memory";
+        case SQLite::JournalMode::WAL: return "wal";
+        case SQLite::JournalMode::Off: return "off";
+        default: throw SQLite::OtherError("unknown journal mode");
     }
 }
 
-void SQLite::Statement::bind(int index, const Blob& blob) {
-    ensure();
-    if (sqlite3_bind_blob(stmt, index, blob.data, blob.size, SQLITE_TRANSIENT) != SQLITE_OK) {
-        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind blob");
+void SQLite::applyOptions(const OpenOptions& options) {
+    // lookaside can only be changed while the connection has no outstanding lookaside memory
+    if (options.lookaside) {
+        if (sqlite3_db_config(db, SQLITE_DBCONFIG_LOOKASIDE, nullptr, options.lookaside->slotSize, options.lookaside->slotCount) != SQLITE_OK) {
+            throwSQLiteError(db, "failed to configure lookaside");
+        }
+    }
+    if (options.pageSize) {
+        exec("PRAGMA page_size=" + std::to_string(*options.pageSize));
+    }
+    if (options.journalMode) {
+        // journal_mode reports the resulting mode instead of failing (e.g. WAL on an in-memory database)
+        const char* mode = toPragmaValue(*options.journalMode);
+        auto pragma = prepare(std::string("PRAGMA journal_mode=") + mode);
+        if (!pragma.step() || pragma.getStringView(0) != mode) {
+            throw SQLite::OtherError(std::string("failed to set journal mode ") + mode);
+        }
+    }
+    if (options.synchronous) {
+        exec("PRAGMA synchronous=" + std::to_string(static_cast<int>(*options.synchronous)));
+    }
+    if (options.mmapSize) {
+        exec("PRAGMA mmap_size=" + std::to_string(*options.mmapSize));
+    }
+    if (options.cacheSize) {
+        exec("PRAGMA cache_size=" + std::to_string(*options.cacheSize));
+    }
+    if (options.tempStore) {
+        exec("PRAGMA temp_store=" + std::to_string(static_cast<int>(*options.tempStore)));
+    }
+    if (options.walAutocheckpoint) {
+        exec("PRAGMA wal_autocheckpoint=" + std::to_string(*options.walAutocheckpoint));
     }
 }
 
-int SQLite::Statement::columnCount() const {
-    ensure();
-    return sqlite3_column_count(stmt);
+int64_t SQLite::pragmaInt(const char* name) const {
+    Statement pragma(db, std::string("PRAGMA ") + name);
+    return pragma.step() ? pragma.getInt64(0) : 0;
 }
 
-SQLite::DataType SQLite::Statement::getColumnType(int index) const {
+SQLite::OpenOptions SQLite::getOptions() const {
     ensure();
-    switch (sqlite3_column_type(stmt, index)) {
-        case SQLITE_INTEGER: return DataType::Integer;
-        case SQLITE_FLOAT: return DataType::Float;
-        case SQLITE_TEXT: return DataType::Text;
-        case SQLITE_BLOB: return DataType::Blob;
-        case SQLITE_NULL: return DataType::Null;
-        default: throw SQLite::OtherError("unknown column type");
+    OpenOptions options;
+    options.pageSize = static_cast<int>(pragmaInt("page_size"));
+    {
+        Statement pragma(db, "PRAGMA journal_mode");
+        if (pragma.step()) {
+            std::string_view mode = pragma.getStringView(0);
+            for (auto candidate : {JournalMode::Delete, JournalMode::Truncate, JournalMode::Persist, JournalMode::Memory,
+                    JournalMode::WAL, JournalMode::Off}) {
+                if (mode == toPragmaValue(candidate)) {
+                    options.journalMode = candidate;
+                }
+            }
+        }
     }
+    options.synchronous = static_cast<Synchronous>(pragmaInt("synchronous"));
+    options.mmapSize = pragmaInt("mmap_size");
+    options.cacheSize = static_cast<int>(pragmaInt("cache_size"));
+    options.tempStore = static_cast<TempStore>(pragmaInt("temp_store"));
+    options.walAutocheckpoint = static_cast<int>(pragmaInt("wal_autocheckpoint"));
+    return options;
 }
 
-std::string SQLite::Statement::getColumnDeclType(int index) const {
-    ensure();
-    const char* declType = sqlite3_column_decltype(stmt, index);
-    return declType ? declType : "";
+void SQLite::close() {
+    if (db) {
+        if (statementCache_) {
+            statementCache_->clear();
+        }
+        setTokenConnection(nullptr); // no sqlite3_interrupt() on a closed (or closing) connection
+        if (sqlite3_close(db) != SQLITE_OK) {
+            setTokenConnection(db); // still open
+            throwSQLiteError(db, "failed to close connection");
+        }
+        db = nullptr;
+    }
 }
 
-std::string SQLite::Statement::getColumnName(int index) const {
-    ensure();
-    const char* name = sqlite3_column_name(stmt, index);
-    return name ? name : "";
+void SQLite::setTokenConnection(sqlite3* connection) {
+    if (progress && progress->token) {
+        std::lock_guard<std::mutex> lock(progress->token->mutex);
+        progress->token->db = connection;
+    }
 }
 
-std::string SQLite::Statement::getColumnOriginName(int index) const {
-#ifdef SQLITE_ENABLE_COLUMN_METADATA
+void SQLite::interrupt() {
     ensure();
-    const char* originName = sqlite3_column_origin_name(stmt, index);
-    return originName ? originName : "";
-#else
-    throw SQLite::OtherError("column metadata not enabled, to enable, define SQLITE_ENABLE_COLUMN_METADATA");
-#endif
+    sqlite3_interrupt(db);
 }
 
-std::string SQLite::Statement::getColumnTableName(int index) const {
-#ifdef SQLITE_ENABLE_COLUMN_METADATA
-    ensure();
-    const char* tableName = sqlite3_column_table_name(stmt, index);
-    return tableName ? tableName : "";
-#else
-    throw SQLite::OtherError("column metadata not enabled, to enable, define SQLITE_ENABLE_COLUMN_METADATA");
-#endif
+void SQLite::CancellationToken::cancel() const {
+    if (!state) {
+        throw OtherError("cancellation token not initialized");
+    }
+    state->cancelled = true;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->db) {
+        sqlite3_interrupt(state->db);
+    }
 }
 
-std::string SQLite::Statement::getColumnDatabaseName(int index) const {
-#ifdef SQLITE_ENABLE_COLUMN_METADATA
-    ensure();
-    const char* dbName = sqlite3_column_database_name(stmt, index);
-    return dbName ? dbName : "";
-#else
-    throw SQLite::OtherError("column metadata not enabled, to enable, define SQLITE_ENABLE_COLUMN_METADATA");
-#endif
+void SQLite::CancellationToken::reset() const {
+    if (state) {
+        state->cancelled = false;
+    }
 }
 
+bool SQLite::CancellationToken::isCancelled() const {
+    return state && state->cancelled;
+}
 
-int SQLite::Statement::getInt(int index) const {
-    ensure();
-    return sqlite3_column_int(stmt, index);
+SQLite::Progress& SQLite::progressState() {
+    if (!progress) {
+        progress = std::make_unique<Progress>();
+        if (db) {
+            sqlite3_progress_handler(db, progress->interval, progressCallback, progress.get());
+        }
+    }
+    return *progress;
 }
 
-int64_t SQLite::Statement::getInt64(int index) const {
-    ensure();
-    return sqlite3_column_int64(stmt, index);
+int SQLite::progressCallback(void* context) {
+    auto& progress = *static_cast<Progress*>(context);
+    if (progress.token && progress.token->cancelled.load(std::memory_order_relaxed)) {
+        return 1;
+    }
+    if (progress.deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= progress.deadline) {
+        return 1;
+    }
+    if (progress.handler) {
+        try {
+            return progress.handler() ? 1 : 0;
+        } catch (...) {
+            return 1; // cannot propagate through SQLite
+        }
+    }
+    return 0;
 }
 
-double SQLite::Statement::getDouble(int index) const {
-    ensure();
-    return sqlite3_column_double(stmt, index);
+SQLite::CancellationToken SQLite::cancellationToken() {
+    Progress& state = progressState();
+    if (!state.token) {
+        state.token = std::make_shared<CancellationToken::State>();
+        state.token->db = db;
+    }
+    return CancellationToken(state.token);
 }
 
-std::string SQLite::Statement::getString(int index) const {
-    ensure();
-    const unsigned char* text = sqlite3_column_text(stmt, index);
-    int size = sqlite3_column_bytes(stmt, index);
-    return text ? std::string(reinterpret_cast<const char*>(text), size) : std::string();
+SQLite::Deadline::Deadline(SQLite& db, std::chrono::steady_clock::time_point deadline) : db(&db) {
+    Progress& state = db.progressState();
+    previous = state.deadline;
+    this->deadline = std::min(previous, deadline);
+    state.deadline = this->deadline;
 }
 
-SQLite::Blob SQLite::Statement::getBlob(int index) const {
-    ensure();
-    Blob blob;
-    blob.data = sqlite3_column_blob(stmt, index);
-    blob.size = sqlite3_column_bytes(stmt, index);
-    return blob;
+SQLite::Deadline::~Deadline() {
+    if (db->progress) {
+        db->progress->deadline = previous;
+    }
 }
 
+void SQLite::setProgressHandler(std::function<bool()> handler) {
+    progressState().handler = std::move(handler);
+}
 
-bool SQLite::Statement::step() {
-    ensure();
-    int result = sqlite3_step(stmt);
-    if (result == SQLITE_ROW) {
-        return true;
-    } else if (result == SQLITE_DONE) {
-        return false;
-    } else {
-        throwSQLiteError(sqlite3_db_handle(stmt), "failed to step statement");
+void SQLite::clearProgressHandler() {
+    if (progress) {
+        progress->handler = nullptr;
     }
-    return false; // silence compiler warning
 }
 
-void SQLite::Statement::reset() {
-    ensure();
-    if (sqlite3_reset(stmt) != SQLITE_OK) {
-        throwSQLiteError(sqlite3_db_handle(stmt), "failed to reset statement");
+void SQLite::setProgressInterval(int instructions) {
+    if (instructions < 1) {
+        throw OtherError("progress interval must be positive");
+    }
+    Progress& state = progressState();
+    state.interval = instructions;
+    if (db) {
+        sqlite3_progress_handler(db, state.interval, progressCallback, progress.get());
+    }
+}
+
+SQLite::~SQLite() {
+    close();
+}
+
+static size_t busyHistogramBucket(int64_t micros) {
+    size_t i = 0;
+    while (i < SQLite::BusyStats::bucketBounds.size() && micros > SQLite::BusyStats::bucketBounds[i]) {
+        ++i;
+    }
+    return i;
+}
+
+// called by SQLite with the number of prior calls for the same lock conflict, return 0 to give up
+int SQLite::busyCallback(void* context, int count) {
+    auto& handler = *static_cast<BusyHandler*>(context);
+    const BusyPolicy& policy = handler.policy;
+    auto now = std::chrono::steady_clock::now();
+
+    // the histogram counts every conflict once, in the bucket of its wait so far
+    if (count == 0) {
+        handler.eventStart = now;
+        handler.eventBucket = 0;
+        ++handler.events;
+        ++handler.histogram[0];
+    }
+    auto waited = std::chrono::duration_cast<std::chrono::microseconds>(now - handler.eventStart);
+
+    double delay = static_cast<double>(policy.initialDelay.count());
+    for (int i = 0; i < count && delay < policy.maxDelay.count(); ++i) {
+        delay *= policy.multiplier;
+    }
+    if (delay > policy.maxDelay.count()) {
+        delay = static_cast<double>(policy.maxDelay.count());
+    }
+    if (policy.jitter && delay > 1) {
+        std::minstd_rand random(handler.random);
+        delay = std::uniform_real_distribution<double>(delay / 2, delay)(random);
+        handler.random = random();
+    }
+    auto sleep = std::chrono::microseconds(static_cast<int64_t>(delay));
+
+    if ((policy.maxRetries >= 0 && count >= policy.maxRetries) || waited + sleep > policy.timeout) {
+        ++handler.timeouts;
+        return 0;
+    }
+
+    std::this_thread::sleep_for(sleep);
+    ++handler.retries;
+
+    auto after = std::chrono::steady_clock::now();
+    handler.waitMicros += std::chrono::duration_cast<std::chrono::microseconds>(after - now).count();
+    size_t bucket = busyHistogramBucket(std::chrono::duration_cast<std::chrono::microseconds>(after - handler.eventStart).count());
+    if (bucket != handler.eventBucket) {
+        --handler.histogram[handler.eventBucket];
+        ++handler.histogram[bucket];
+        handler.eventBucket = bucket;
+    }
+    return 1;
+}
+
+void SQLite::setBusyPolicy(const BusyPolicy& policy) {
+    if (!busyHandler) {
+        busyHandler = std::make_unique<BusyHandler>();
+        busyHandler->random = std::random_device()();
+    }
+    busyHandler->policy = policy;
+    if (db) {
+        sqlite3_busy_handler(db, busyCallback, busyHandler.get());
+    }
+}
+
+void SQLite::setBusyTimeout(std::chrono::milliseconds timeout) {
+    ensure();
+    busyHandler.reset();
+    sqlite3_busy_timeout(db, static_cast<int>(timeout.count()));
+}
+
+void SQLite::clearBusyHandler() {
+    busyHandler.reset();
+    if (db) {
+        sqlite3_busy_handler(db, nullptr, nullptr);
+    }
+}
+
+int64_t SQLite::QueryProfile::percentile(double p) const {
+    uint64_t total = 0;
+    for (uint64_t count : histogram) {
+        total += count;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p * total + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets; ++i) {
+        seen += histogram[i];
+        if (seen >= rank) {
+            return bucketBound(i);
+        }
+    }
+    return bucketBound(buckets - 1);
+}
+
+static size_t profileHistogramBucket(int64_t micros) {
+    size_t bucket = 0;
+    while (bucket + 1 < SQLite::QueryProfile::buckets && micros > SQLite::QueryProfile::bucketBound(bucket)) {
+        ++bucket;
+    }
+    return bucket;
+}
+
+int SQLite::traceCallback(unsigned type, void* context, void* p, void* x) {
+    // exceptions (bad_alloc, or thrown by onSlowQuery) cannot unwind through sqlite3_step's C frames
+    try {
+        auto& profiler = *static_cast<Profiler*>(context);
+        auto stmt = static_cast<sqlite3_stmt*>(p);
+
+        if (type == SQLITE_TRACE_ROW) {
+            ++profiler.runningRows[stmt]; // only touched on the connection's thread
+            return 0;
+        }
+        if (type != SQLITE_TRACE_PROFILE) {
+            return 0;
+        }
+
+        int64_t nanos = *static_cast<sqlite3_int64*>(x);
+        uint64_t fullScanSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+        uint64_t sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+        uint64_t autoIndexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+        uint64_t vmSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+        uint64_t rows = 0;
+        if (profiler.options.countRows) {
+            auto it = profiler.runningRows.find(stmt);
+            if (it != profiler.runningRows.end()) {
+                rows = it->second;
+                profiler.runningRows.erase(it);
+            }
+        }
+
+        const char* text = sqlite3_sql(stmt);
+        std::string_view sql = text ? text : "";
+        {
+            std::lock_guard<std::mutex> lock(profiler.mutex);
+            auto it = profiler.profiles.find(sql);
+            if (it == profiler.profiles.end()) {
+                auto profile = std::make_unique<QueryProfile>();
+                profile->sql = sql;
+                std::string_view key = profile->sql;
+                it = profiler.profiles.emplace(key, std::move(profile)).first;
+            }
+            QueryProfile& profile = *it->second;
+            ++profile.calls;
+            profile.totalNanos += nanos;
+            if (static_cast<uint64_t>(nanos) > profile.maxNanos) {
+                profile.maxNanos = nanos;
+            }
+            profile.rows += rows;
+            profile.fullScanSteps += fullScanSteps;
+            profile.sorts += sorts;
+            profile.autoIndexes += autoIndexes;
+            profile.vmSteps += vmSteps;
+            ++profile.histogram[profileHistogramBucket(nanos / 1000)];
+        }
+
+        const ProfilerOptions& options = profiler.options;
+        if (options.onSlowQuery && options.slowQueryThreshold.count() > 0 && nanos >= options.slowQueryThreshold.count()) {
+            SlowQuery slow{sql, "", std::chrono::nanoseconds(nanos), rows, fullScanSteps, sorts, autoIndexes, vmSteps};
+            std::unique_ptr<char, decltype(&sqlite3_free)> expanded(sqlite3_expanded_sql(stmt), sqlite3_free);
+            if (expanded) {
+                slow.expandedSql = expanded.get();
+            }
+            options.onSlowQuery(slow);
+        }
+    } catch (...) {
+        // dropped, the statement's result is not affected by profiling
+    }
+    return 0;
+}
+
+void SQLite::installTrace() {
+    unsigned mask = SQLITE_TRACE_PROFILE | (profiler->options.countRows ? SQLITE_TRACE_ROW : 0);
+    sqlite3_trace_v2(db, mask, traceCallback, profiler.get());
+}
+
+void SQLite::enableProfiling() {
+    enableProfiling(ProfilerOptions());
+}
+
+void SQLite::enableProfiling(const ProfilerOptions& options) {
+    if (!profiler) {
+        profiler = std::make_unique<Profiler>();
+    }
+    profiler->options = options;
+    profiler->runningRows.clear();
+    if (db) {
+        installTrace();
+    }
+}
+
+void SQLite::disableProfiling() {
+    if (db) {
+        sqlite3_trace_v2(db, 0, nullptr, nullptr);
+    }
+    profiler.reset();
+}
+
+std::vector<SQLite::QueryProfile> SQLite::profileSnapshot() const {
+    std::vector<QueryProfile> snapshot;
+    if (profiler) {
+        std::lock_guard<std::mutex> lock(profiler->mutex);
+        snapshot.reserve(profiler->profiles.size());
+        for (const auto& entry : profiler->profiles) {
+            snapshot.push_back(*entry.second);
+        }
+    }
+    return snapshot;
+}
+
+void SQLite::resetProfiles() {
+    if (profiler) {
+        std::lock_guard<std::mutex> lock(profiler->mutex);
+        profiler->profiles.clear();
+    }
+}
+
+static bool startsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+bool SQLite::QueryPlan::Node::isScan() const {
+    return startsWith(detail, "SCAN ") && detail != "SCAN CONSTANT ROW" && !startsWith(detail, "SCAN (");
+}
+
+bool SQLite::QueryPlan::Node::isSearch() const {
+    return startsWith(detail, "SEARCH ");
+}
+
+bool SQLite::QueryPlan::Node::usesAutomaticIndex() const {
+    return (isScan() || isSearch()) && detail.find(" USING AUTOMATIC ") != std::string::npos;
+}
+
+bool SQLite::QueryPlan::Node::usesTempBTree() const {
+    return startsWith(detail, "USE TEMP B-TREE ");
+}
+
+std::string_view SQLite::QueryPlan::Node::table() const {
+    if (!isScan() && !isSearch()) {
+        return {};
+    }
+    std::string_view text = detail;
+    text.remove_prefix(text.find(' ') + 1);
+    return text.substr(0, text.find(' '));
+}
+
+std::string_view SQLite::QueryPlan::Node::index() const {
+    if (!isScan() && !isSearch()) {
+        return {};
+    }
+    std::string_view text = detail;
+    size_t using_ = text.find(" USING ");
+    if (using_ == std::string_view::npos) {
+        return {};
+    }
+    text.remove_prefix(using_ + 7);
+    if (startsWith(text, "INTEGER PRIMARY KEY")) {
+        return text.substr(0, 19);
+    }
+    for (std::string_view prefix : {"AUTOMATIC ", "PARTIAL ", "COVERING "}) {
+        if (startsWith(text, prefix)) {
+            text.remove_prefix(prefix.size());
+        }
+    }
+    if (!startsWith(text, "INDEX ")) {
+        return {};
+    }
+    text.remove_prefix(6);
+    return text.substr(0, text.find(' '));
+}
+
+bool SQLite::QueryPlan::usesIndex(std::string_view index) const {
+    bool found = false;
+    forEach([&](const Node& node) { found = found || node.index() == index; });
+    return found;
+}
+
+bool SQLite::QueryPlan::hasFullScan() const {
+    bool found = false;
+    forEach([&](const Node& node) { found = found || node.isScan(); });
+    return found;
+}
+
+bool SQLite::QueryPlan::hasFullScan(std::string_view table) const {
+    bool found = false;
+    forEach([&](const Node& node) { found = found || (node.isScan() && node.table() == table); });
+    return found;
+}
+
+bool SQLite::QueryPlan::usesAutomaticIndex() const {
+    bool found = false;
+    forEach([&](const Node& node) { found = found || node.usesAutomaticIndex(); });
+    return found;
+}
+
+bool SQLite::QueryPlan::usesTempBTree() const {
+    bool found = false;
+    forEach([&](const Node& node) { found = found || node.usesTempBTree(); });
+    return found;
+}
+
+static void appendPlan(std::string& out, const std::vector<SQLite::QueryPlan::Node>& nodes, size_t depth) {
+    for (const auto& node : nodes) {
+        out.append(2 * depth, ' ');
+        out += node.detail;
+        out += '\n';
+        appendPlan(out, node.children, depth + 1);
+    }
+}
+
+std::string SQLite::QueryPlan::toString() const {
+    std::string out;
+    appendPlan(out, nodes, 0);
+    return out;
+}
+
+void SQLite::setPlanGuard(const PlanGuard& guard) {
+    planGuard = std::make_shared<const PlanGuard>(guard);
+    installPlanGuard();
+}
+
+void SQLite::clearPlanGuard() {
+    planGuard.reset();
+    installPlanGuard();
+}
+
+void SQLite::installPlanGuard() {
+    if (!statementCache_) {
+        return;
+    }
+    if (planGuard) {
+        statementCache_->setPrepareCheck([guard = planGuard](const Statement& statement) { checkPlan(*guard, statement); });
+    } else {
+        statementCache_->setPrepareCheck(nullptr);
+    }
+}
+
+void SQLite::checkPlan(const PlanGuard& guard, const Statement& statement) {
+    QueryPlan plan = statement.explainQueryPlan();
+    if (guard.forbidFullScans) {
+        plan.forEach([&](const QueryPlan::Node& node) {
+            if (node.isScan() && std::find(guard.allowedScans.begin(), guard.allowedScans.end(), node.table()) == guard.allowedScans.end()) {
+                throw PlanError("full scan of " + std::string(node.table()), statement.sql(), plan.toString());
+            }
+        });
+    }
+    if (guard.forbidAutomaticIndexes && plan.usesAutomaticIndex()) {
+        throw PlanError("automatic index", statement.sql(), plan.toString());
+    }
+    if (guard.check) {
+        guard.check(statement, plan);
+    }
+}
+
+SQLite::BusyStats SQLite::busyStats() const {
+    BusyStats stats;
+    if (busyHandler) {
+        stats.events = busyHandler->events;
+        stats.retries = busyHandler->retries;
+        stats.timeouts = busyHandler->timeouts;
+        stats.waitMicros = busyHandler->waitMicros;
+        for (size_t i = 0; i < stats.histogram.size(); ++i) {
+            stats.histogram[i] = busyHandler->histogram[i];
+        }
+    }
+    return stats;
+}
+
+int SQLite::toSQLiteOpenFlags(OpenFlags flags) {
+    int sqliteFlags = 0;
+
+    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::ReadOnly)) sqliteFlags |= SQLITE_OPEN_READONLY;
+    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::ReadWrite)) sqliteFlags |= SQLITE_OPEN_READWRITE;
+    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::Create)) sqliteFlags |= SQLITE_OPEN_CREATE;
+    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::URI)) sqliteFlags |= SQLITE_OPEN_URI;
+    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::Memory)) sqliteFlags |= SQLITE_OPEN_MEMORY;
+    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::NoMutex)) sqliteFlags |= SQLITE_OPEN_NOMUTEX;
+    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::FullMutex)) sqliteFlags |= SQLITE_OPEN_FULLMUTEX;
+    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::SharedCache)) sqliteFlags |= SQLITE_OPEN_SHAREDCACHE;
+    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::PrivateCache)) sqliteFlags |= SQLITE_OPEN_PRIVATECACHE;
+    if (static_cast<int>(flags) & static_cast<int>(OpenFlags::NoFollow)) sqliteFlags |= SQLITE_OPEN_NOFOLLOW;
+
+    return sqliteFlags;
+}
+
+SQLite::Statement::Statement(sqlite3* db, const std::string& sql, bool persistent) {
+    int prepareFlags = persistent ? SQLITE_PREPARE_PERSISTENT : 0;
+    if (sqlite3_prepare_v3(db, sql.c_str(), -1, prepareFlags, &stmt, nullptr) != SQLITE_OK) {
+        throwSQLiteError(db, "failed to prepare statement", sql);
+    }
+}
+
+std::string SQLite::Statement::sql() const {
+    ensure();
+    const char* text = sqlite3_sql(stmt);
+    return text ? text : "";
+}
+
+SQLite::QueryPlan SQLite::Statement::explainQueryPlan() const {
+    ensure();
+    Statement explain(sqlite3_db_handle(stmt), "EXPLAIN QUERY PLAN " + sql());
+
+    // rows are (id, parent, notused, detail) with parents listed before their children
+    struct Row {
+        int id;
+        int parent;
+        std::string detail;
+    };
+    std::vector<Row> rows;
+    while (explain.step()) {
+        rows.push_back(Row{explain.getInt(0), explain.getInt(1), explain.getString(3)});
+    }
+
+    QueryPlan plan;
+    std::vector<std::pair<int, std::vector<QueryPlan::Node>*>> path; // open ancestors, innermost last
+    for (auto& row : rows) {
+        while (!path.empty() && path.back().first != row.parent) {
+            path.pop_back();
+        }
+        auto& siblings = path.empty() ? plan.nodes : *path.back().second;
+        siblings.push_back(QueryPlan::Node{row.id, std::move(row.detail), {}});
+        path.emplace_back(row.id, &siblings.back().children);
+    }
+    return plan;
+}
+
+void SQLite::Statement::requireIndex(std::string_view index) const {
+    QueryPlan plan = explainQueryPlan();
+    if (!plan.usesIndex(index)) {
+        throw PlanError("index " + std::string(index) + " not used", sql(), plan.toString());
+    }
+}
+
+void SQLite::Statement::requireNoFullScan() const {
+    QueryPlan plan = explainQueryPlan();
+    if (plan.hasFullScan()) {
+        throw PlanError("full table scan", sql(), plan.toString());
+    }
+}
+
+SQLite::StatementStatus SQLite::Statement::status() const {
+    ensure();
+    StatementStatus status;
+    status.fullScanSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+    status.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0);
+    status.autoIndexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0);
+    status.vmSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+    return status;
+}
+
+SQLite::StatementStatus SQLite::Statement::resetStatus() {
+    ensure();
+    StatementStatus status;
+    status.fullScanSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+    status.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+    status.autoIndexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+    status.vmSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+    return status;
+}
+
+SQLite::Statement::~Statement() {
+    // sqlite3_finalize() repeats the error of a failed last step, which was already thrown by step()
+    if (stmt) {
+        sqlite3_finalize(stmt);
+    }
+}
+
+SQLite::Statement::Statement(Statement&& other) noexcept : stmt(other.stmt), columnMap(std::move(other.columnMap)),
+        batchDone(other.batchDone), ownedBindings(std::move(other.ownedBindings)) {
+    other.stmt = nullptr;
+}
+
+SQLite::Statement& SQLite::Statement::operator=(Statement&& other) noexcept {
+    if (this != &other) {
+        finalize();
+        stmt = other.stmt;
+        other.stmt = nullptr;
+
+        columnMap = std::move(other.columnMap);
+        batchDone = other.batchDone;
+        ownedBindings = std::move(other.ownedBindings);
+    }
+    return *this;
+}
+
+void SQLite::Statement::finalize() {
+    if (stmt) {
+        if (sqlite3_finalize(stmt) != SQLITE_OK) {
+            throwSQLiteError(sqlite3_db_handle(stmt), "failed to finalize statement");
+        }
+        stmt = nullptr;
+    }
+    ownedBindings.clear();
+}
+
+// flat name -> index table: up to SmallSize entries are scanned in place, larger results are sorted and bisected
+struct SQLite::Statement::ColumnMap {
+    static constexpr int SmallSize = 16;
+
+    struct Entry {
+        std::string_view name; // points into names
+        int index;
+    };
+
+    int count = 0;
+    std::pmr::vector<char> names;
+    std::array<Entry, SmallSize> small{};
+    std::pmr::vector<Entry> large;
+
+    ColumnMap(sqlite3_stmt* stmt, std::pmr::memory_resource* resource)
+            : count(sqlite3_column_count(stmt)), names(resource), large(resource) {
+        // copy all names into one buffer, so lookups by std::string_view need no allocation
+        size_t size = 0;
+        for (int i = 0; i < count; ++i) {
+            const char* columnName = sqlite3_column_name(stmt, i);
+            if (columnName) {
+                size += std::char_traits<char>::length(columnName);
+            }
+        }
+        names.resize(size);
+
+        Entry* entries = small.data();
+        if (count > SmallSize) {
+            large.resize(count);
+            entries = large.data();
+        }
+        int used = 0;
+        size_t offset = 0;
+        for (int i = 0; i < count; ++i) {
+            const char* columnName = sqlite3_column_name(stmt, i);
+            if (columnName) {
+                size_t length = std::char_traits<char>::length(columnName);
+                std::char_traits<char>::copy(names.data() + offset, columnName, length);
+                entries[used++] = Entry{std::string_view(names.data() + offset, length), i};
+                offset += length;
+            }
+        }
+        if (count > SmallSize) {
+            large.resize(used);
+            // stable, so the last of duplicate names stays last and wins as before
+            std::stable_sort(large.begin(), large.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+        } else {
+            smallUsed = used;
+        }
+    }
+
+    int find(std::string_view name) const {
+        if (count <= SmallSize) {
+            for (int i = smallUsed - 1; i >= 0; --i) { // last of duplicate names wins
+                if (small[i].name == name) {
+                    return small[i].index;
+                }
+            }
+            return -1;
+        }
+        auto it = std::upper_bound(large.begin(), large.end(), name,
+                [](std::string_view key, const Entry& entry) { return key < entry.name; });
+        return it != large.begin() && (--it)->name == name ? it->index : -1;
+    }
+
+private:
+    int smallUsed = 0;
+};
+
+const SQLite::Statement::ColumnMap& SQLite::Statement::columns() const {
+    ensure();
+    // a reprepare after a schema change may change the result columns (SELECT *)
+    if (!columnMap || columnMap->count != sqlite3_column_count(stmt)) {
+        std::pmr::memory_resource* resource = memoryResource();
+        columnMap = std::allocate_shared<ColumnMap>(std::pmr::polymorphic_allocator<ColumnMap>(resource), stmt, resource);
+    }
+    return *columnMap;
+}
+
+int SQLite::Statement::getColumnIndex(std::string_view columnName) const {
+    int index = columns().find(columnName);
+    if (index >= 0) {
+        return index;
+    }
+    throw SQLite::OtherError(std::string("column not found: ").append(columnName));
+}
+
+int SQLite::Statement::getParamIndex(const std::string& paramName) const {
+    ensure();
+    int index = sqlite3_bind_parameter_index(stmt, paramName.c_str());
+    if (index == 0) {
+        throw SQLite::OtherError("parameter not found: " + paramName);
+    }
+    return index;
+}
+
+int SQLite::Statement::paramCount() const {
+    ensure();
+    return sqlite3_bind_parameter_count(stmt);
+}
+
+std::string SQLite::Statement::getParamName(int index) const {
+    ensure();
+    const char* name = sqlite3_bind_parameter_name(stmt, index);
+    if (name) {
+        return name;
+    }
+    return "";
+}
+
+void SQLite::Statement::bind(int index, int value) {
+    ensure();
+    if (sqlite3_bind_int(stmt, index, value) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind int");
+    }
+}
+
+void SQLite::Statement::bind(int index, int64_t value) {
+    ensure();
+    if (sqlite3_bind_int64(stmt, index, value) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind int64");
+    }
+}
+
+void SQLite::Statement::bind(int index, double value) {
+    ensure();
+    if (sqlite3_bind_double(stmt, index, value) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind double");
+    }
+}
+
+void SQLite::Statement::bind(int index, const std::string& value) {
+    ensure();
+    if (sqlite3_bind_text(stmt, index, value.c_str(), value.size(), SQLITE_TRANSIENT) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind text");
+    }
+}
+
+void SQLite::Statement::bind(int index, std::string_view value) {
+    ensure();
+    if (sqlite3_bind_text(stmt, index, value.data(), value.size(), SQLITE_TRANSIENT) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind text");
+    }
+}
+
+void SQLite::Statement::bind(int index, const char* value) {
+    ensure();
+    if (sqlite3_bind_text(stmt, index, value, -1, SQLITE_TRANSIENT) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind text");
+    }
+}
+
+void SQLite::Statement::bind(int index, const Blob& blob) {
+    ensure();
+    if (sqlite3_bind_blob(stmt, index, blob.data, blob.size, SQLITE_TRANSIENT) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind blob");
+    }
+}
+
+void SQLite::Statement::bind(int index, ZeroBlob value) {
+    ensure();
+    if (sqlite3_bind_zeroblob64(stmt, index, value.size) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind zeroblob");
+    }
+}
+
+void SQLite::Statement::bind(int index, std::nullptr_t) {
+    ensure();
+    if (sqlite3_bind_null(stmt, index) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind null");
+    }
+}
+
+void SQLite::Statement::bind(int index, std::string_view value, Borrowed) {
+    ensure();
+    if (sqlite3_bind_text(stmt, index, value.data(), value.size(), SQLITE_STATIC) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind text");
+    }
+}
+
+void SQLite::Statement::bind(int index, const Blob& blob, Borrowed) {
+    ensure();
+    if (sqlite3_bind_blob(stmt, index, blob.data, blob.size, SQLITE_STATIC) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind blob");
+    }
+}
+
+void SQLite::Statement::bind(int index, std::string&& value) {
+    ensure();
+    if (index < 1 || index > sqlite3_bind_parameter_count(stmt)) {
+        throw SQLite::OtherError("parameter index out of range: " + std::to_string(index));
+    }
+    if (ownedBindings.size() < static_cast<size_t>(index)) {
+        ownedBindings.resize(sqlite3_bind_parameter_count(stmt));
+    }
+    // SQLite keeps the previous binding when a bind fails (e.g. SQLITE_MISUSE while the statement is running),
+    // so detach it with a NULL before the buffer it points to is released
+    if (sqlite3_bind_null(stmt, index) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind text");
+    }
+    auto& owned = ownedBindings[index - 1].emplace<std::string>(std::move(value));
+    if (sqlite3_bind_text(stmt, index, owned.data(), owned.size(), SQLITE_STATIC) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind text");
+    }
+}
+
+void SQLite::Statement::bind(int index, std::vector<std::byte>&& value) {
+    ensure();
+    if (index < 1 || index > sqlite3_bind_parameter_count(stmt)) {
+        throw SQLite::OtherError("parameter index out of range: " + std::to_string(index));
+    }
+    if (ownedBindings.size() < static_cast<size_t>(index)) {
+        ownedBindings.resize(sqlite3_bind_parameter_count(stmt));
+    }
+    if (sqlite3_bind_null(stmt, index) != SQLITE_OK) { // see bind(int, std::string&&)
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind blob");
+    }
+    auto& owned = ownedBindings[index - 1].emplace<std::vector<std::byte>>(std::move(value));
+    if (sqlite3_bind_blob(stmt, index, owned.data(), owned.size(), SQLITE_STATIC) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to bind blob");
+    }
+}
+
+int SQLite::Statement::columnCount() const {
+    ensure();
+    return sqlite3_column_count(stmt);
+}
+
+SQLite::DataType SQLite::Statement::getColumnType(int index) const {
+    ensure();
+    switch (sqlite3_column_type(stmt, index)) {
+        case SQLITE_INTEGER: return DataType::Integer;
+        case SQLITE_FLOAT: return DataType::Float;
+        case SQLITE_TEXT: return DataType::Text;
+        case SQLITE_BLOB: return DataType::Blob;
+        case SQLITE_NULL: return DataType::Null;
+        default: throw SQLite::OtherError("unknown column type");
+    }
+}
+
+std::string SQLite::Statement::getColumnDeclType(int index) const {
+    ensure();
+    const char* declType = sqlite3_column_decltype(stmt, index);
+    return declType ? declType : "";
+}
+
+std::string SQLite::Statement::getColumnName(int index) const {
+    ensure();
+    const char* name = sqlite3_column_name(stmt, index);
+    return name ? name : "";
+}
+
+std::string SQLite::Statement::getColumnOriginName(int index) const {
+#ifdef SQLITE_ENABLE_COLUMN_METADATA
+    ensure();
+    const char* originName = sqlite3_column_origin_name(stmt, index);
+    return originName ? originName : "";
+#else
+    throw SQLite::OtherError("column metadata not enabled, to enable, define SQLITE_ENABLE_COLUMN_METADATA");
+#endif
+}
+
+std::string SQLite::Statement::getColumnTableName(int index) const {
+#ifdef SQLITE_ENABLE_COLUMN_METADATA
+    ensure();
+    const char* tableName = sqlite3_column_table_name(stmt, index);
+    return tableName ? tableName : "";
+#else
+    throw SQLite::OtherError("column metadata not enabled, to enable, define SQLITE_ENABLE_COLUMN_METADATA");
+#endif
+}
+
+std::string SQLite::Statement::getColumnDatabaseName(int index) const {
+#ifdef SQLITE_ENABLE_COLUMN_METADATA
+    ensure();
+    const char* dbName = sqlite3_column_database_name(stmt, index);
+    return dbName ? dbName : "";
+#else
+    throw SQLite::OtherError("column metadata not enabled, to enable, define SQLITE_ENABLE_COLUMN_METADATA");
+#endif
+}
+
+
+int SQLite::Statement::getInt(int index) const {
+    ensure();
+    return sqlite3_column_int(stmt, index);
+}
+
+int64_t SQLite::Statement::getInt64(int index) const {
+    ensure();
+    return sqlite3_column_int64(stmt, index);
+}
+
+double SQLite::Statement::getDouble(int index) const {
+    ensure();
+    return sqlite3_column_double(stmt, index);
+}
+
+std::string SQLite::Statement::getString(int index) const {
+    ensure();
+    const unsigned char* text = sqlite3_column_text(stmt, index);
+    int size = sqlite3_column_bytes(stmt, index);
+    return text ? std::string(reinterpret_cast<const char*>(text), size) : std::string();
+}
+
+std::string_view SQLite::Statement::getStringView(int index) const {
+    ensure();
+    const unsigned char* text = sqlite3_column_text(stmt, index);
+    int size = sqlite3_column_bytes(stmt, index);
+    return text ? std::string_view(reinterpret_cast<const char*>(text), size) : std::string_view();
+}
+
+SQLite::Blob SQLite::Statement::getBlob(int index) const {
+    ensure();
+    Blob blob;
+    blob.data = sqlite3_column_blob(stmt, index);
+    blob.size = sqlite3_column_bytes(stmt, index);
+    return blob;
+}
+
+bool SQLite::Statement::isNull(int index) const {
+    return sqlite3_column_type(stmt, index) == SQLITE_NULL;
+}
+
+void SQLite::Statement::checkRowColumns(size_t count) const {
+    ensure();
+    if (static_cast<size_t>(sqlite3_column_count(stmt)) < count) {
+        throw SQLite::OtherError("statement returns " + std::to_string(sqlite3_column_count(stmt)) + " columns, "
+                + std::to_string(count) + " requested");
+    }
+}
+
+template<> int SQLite::Statement::columnValue<int>(int index) const {
+    return sqlite3_column_int(stmt, index);
+}
+
+template<> int64_t SQLite::Statement::columnValue<int64_t>(int index) const {
+    return sqlite3_column_int64(stmt, index);
+}
+
+template<> double SQLite::Statement::columnValue<double>(int index) const {
+    return sqlite3_column_double(stmt, index);
+}
+
+template<> std::string SQLite::Statement::columnValue<std::string>(int index) const {
+    const unsigned char* text = sqlite3_column_text(stmt, index);
+    return text ? std::string(reinterpret_cast<const char*>(text), sqlite3_column_bytes(stmt, index)) : std::string();
+}
+
+template<> std::string_view SQLite::Statement::columnValue<std::string_view>(int index) const {
+    const unsigned char* text = sqlite3_column_text(stmt, index);
+    return text ? std::string_view(reinterpret_cast<const char*>(text), sqlite3_column_bytes(stmt, index)) : std::string_view();
+}
+
+template<> SQLite::Blob SQLite::Statement::columnValue<SQLite::Blob>(int index) const {
+    Blob blob;
+    blob.data = sqlite3_column_blob(stmt, index);
+    blob.size = sqlite3_column_bytes(stmt, index);
+    return blob;
+}
+
+// column type from declared type affinity rules, for columns whose first value is NULL
+static SQLite::DataType declaredDataType(const char* declType) {
+    std::string type = declType ? declType : "";
+    for (auto& c : type) {
+        c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+    }
+    if (type.find("INT") != std::string::npos) return SQLite::DataType::Integer;
+    if (type.find("CHAR") != std::string::npos || type.find("CLOB") != std::string::npos || type.find("TEXT") != std::string::npos) {
+        return SQLite::DataType::Text;
+    }
+    if (type.empty() || type.find("BLOB") != std::string::npos) return SQLite::DataType::Blob;
+    return SQLite::DataType::Float; // REAL, FLOA, DOUB and NUMERIC affinity
+}
+
+size_t SQLite::Statement::fetchBatch(ColumnBatch& batch, size_t maxRows) {
+    ensure();
+    int columnCount = sqlite3_column_count(stmt);
+    batch.rows = 0;
+    if (batch.columns.size() != static_cast<size_t>(columnCount)) {
+        batch.columns.clear();
+        batch.columns.resize(columnCount);
+    }
+    for (int i = 0; i < columnCount; ++i) {
+        auto& column = batch.columns[i];
+        column.validity.clear();
+        column.nullCount = 0;
+        column.integers.clear();
+        column.floats.clear();
+        column.offsets.assign(1, 0);
+        column.data.clear();
+    }
+
+    // another step() after SQLITE_DONE would run the statement again
+    if (batchDone) {
+        return 0;
+    }
+
+    while (batch.rows < maxRows) {
+        if (!step()) {
+            batchDone = true;
+            break;
+        }
+        size_t row = batch.rows++;
+        for (int i = 0; i < columnCount; ++i) {
+            auto& column = batch.columns[i];
+            int type = sqlite3_column_type(stmt, i);
+
+            if (column.type == DataType::Null) {
+                const char* name = sqlite3_column_name(stmt, i);
+                column.name = name ? name : "";
+                switch (type) {
+                    case SQLITE_INTEGER: column.type = DataType::Integer; break;
+                    case SQLITE_FLOAT: column.type = DataType::Float; break;
+                    case SQLITE_TEXT: column.type = DataType::Text; break;
+                    case SQLITE_BLOB: column.type = DataType::Blob; break;
+                    default: column.type = declaredDataType(sqlite3_column_decltype(stmt, i)); break;
+                }
+            }
+
+            if (row % 8 == 0) {
+                column.validity.push_back(0);
+            }
+            bool valid = type != SQLITE_NULL;
+            if (valid) {
+                column.validity.back() |= static_cast<uint8_t>(1u << (row % 8));
+            } else {
+                ++column.nullCount;
+            }
+
+            switch (column.type) {
+                case DataType::Integer:
+                    column.integers.push_back(valid ? sqlite3_column_int64(stmt, i) : 0);
+                    break;
+                case DataType::Float:
+                    column.floats.push_back(valid ? sqlite3_column_double(stmt, i) : 0.0);
+                    break;
+                case DataType::Text:
+                case DataType::Blob: {
+                    if (valid) {
+                        const void* value = column.type == DataType::Text
+                                ? static_cast<const void*>(sqlite3_column_text(stmt, i)) : sqlite3_column_blob(stmt, i);
+                        int size = sqlite3_column_bytes(stmt, i);
+                        const char* bytes = static_cast<const char*>(value);
+                        column.data.insert(column.data.end(), bytes, bytes + size);
+                    }
+                    if (column.data.size() > static_cast<size_t>(INT32_MAX)) {
+                        throw SQLite::OtherError("column batch data exceeds 32-bit offsets, fetch smaller batches");
+                    }
+                    column.offsets.push_back(static_cast<int32_t>(column.data.size()));
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+    return batch.rows;
+}
+
+
+bool SQLite::Statement::step() {
+    ensure();
+    int result = sqlite3_step(stmt);
+    if (result == SQLITE_ROW) {
+        return true;
+    } else if (result == SQLITE_DONE) {
+        return false;
+    } else {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to step statement");
+    }
+    return false; // silence compiler warning
+}
+
+void SQLite::Statement::reset() {
+    ensure();
+    batchDone = false;
+    if (sqlite3_reset(stmt) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to reset statement");
+    }
+}
+
+void SQLite::Statement::resetQuietly() noexcept {
+    batchDone = false;
+    if (stmt) {
+        sqlite3_reset(stmt);
     }
 }
 
 void SQLite::Statement::clearBindings() {
     ensure();
-    if (sqlite3_clear_bindings(stmt) != SQLITE_OK) {
-        throwSQLiteError(sqlite3_db_handle(stmt), "failed to clear bindings");
+    if (sqlite3_clear_bindings(stmt) != SQLITE_OK) {
+        throwSQLiteError(sqlite3_db_handle(stmt), "failed to clear bindings");
+    }
+    ownedBindings.clear();
+}
+
+int64_t SQLite::lastInsertRowid() const {
+    ensure();
+    return sqlite3_last_insert_rowid(db);
+}
+
+int SQLite::changes() const {
+    ensure();
+    return sqlite3_changes(db);
+}
+
+void SQLite::registerFunction(const std::string& name, int argumentCount, FunctionFlags flags, void* data,
+        FunctionCallback function, FunctionCallback step, FinalCallback final, void (*destroy)(void*)) {
+    if (!db) {
+        destroy(data);
+        ensure();
+    }
+    int textRep = SQLITE_UTF8;
+    if (flags & FunctionFlags::Deterministic) textRep |= SQLITE_DETERMINISTIC;
+    if (flags & FunctionFlags::DirectOnly) textRep |= SQLITE_DIRECTONLY;
+    if (flags & FunctionFlags::Innocuous) textRep |= SQLITE_INNOCUOUS;
+    // destroy(data) is called by SQLite on failure too
+    if (sqlite3_create_function_v2(db, name.c_str(), argumentCount, textRep, data, function, step, final, destroy) != SQLITE_OK) {
+        throwSQLiteError(db, "failed to create function " + name);
+    }
+}
+
+void* SQLite::functionData(sqlite3_context* context) {
+    return sqlite3_user_data(context);
+}
+
+void** SQLite::aggregateState(sqlite3_context* context, bool create) {
+    return static_cast<void**>(sqlite3_aggregate_context(context, create ? sizeof(void*) : 0));
+}
+
+void SQLite::setErrorResult(sqlite3_context* context, const char* message) {
+    sqlite3_result_error(context, message, -1);
+}
+
+void SQLite::setNoMemoryResult(sqlite3_context* context) {
+    sqlite3_result_error_nomem(context);
+}
+
+bool SQLite::isNullValue(sqlite3_value* value) {
+    return sqlite3_value_type(value) == SQLITE_NULL;
+}
+
+template<> int SQLite::argumentValue<int>(sqlite3_value* value) {
+    return sqlite3_value_int(value);
+}
+
+template<> int64_t SQLite::argumentValue<int64_t>(sqlite3_value* value) {
+    return sqlite3_value_int64(value);
+}
+
+template<> double SQLite::argumentValue<double>(sqlite3_value* value) {
+    return sqlite3_value_double(value);
+}
+
+template<> std::string SQLite::argumentValue<std::string>(sqlite3_value* value) {
+    const unsigned char* text = sqlite3_value_text(value);
+    return text ? std::string(reinterpret_cast<const char*>(text), sqlite3_value_bytes(value)) : std::string();
+}
+
+template<> std::string_view SQLite::argumentValue<std::string_view>(sqlite3_value* value) {
+    const unsigned char* text = sqlite3_value_text(value);
+    return text ? std::string_view(reinterpret_cast<const char*>(text), sqlite3_value_bytes(value)) : std::string_view();
+}
+
+template<> SQLite::Blob SQLite::argumentValue<SQLite::Blob>(sqlite3_value* value) {
+    Blob blob;
+    blob.data = sqlite3_value_blob(value);
+    blob.size = sqlite3_value_bytes(value);
+    return blob;
+}
+
+void SQLite::setResult(sqlite3_context* context, std::nullptr_t) {
+    sqlite3_result_null(context);
+}
+
+void SQLite::setResult(sqlite3_context* context, int value) {
+    sqlite3_result_int(context, value);
+}
+
+void SQLite::setResult(sqlite3_context* context, int64_t value) {
+    sqlite3_result_int64(context, value);
+}
+
+void SQLite::setResult(sqlite3_context* context, double value) {
+    sqlite3_result_double(context, value);
+}
+
+void SQLite::setResult(sqlite3_context* context, std::string_view value) {
+    // a null pointer would make the result NULL instead of empty text
+    sqlite3_result_text64(context, value.data() ? value.data() : "", value.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+}
+
+void SQLite::setResult(sqlite3_context* context, const Blob& value) {
+    if (!value.data) {
+        sqlite3_result_zeroblob(context, 0); // empty blob rather than NULL
+        return;
+    }
+    sqlite3_result_blob64(context, value.data, static_cast<sqlite3_uint64>(value.size), SQLITE_TRANSIENT);
+}
+
+void SQLite::exec(const std::string& sql) {
+    ensure();
+    int result = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr);
+    if (result != SQLITE_OK) {
+        throwSQLiteError(db, "failed to execute SQL query", sql);
+    }
+}
+
+
+SQLite::CachedStatement SQLite::StatementCache::acquire(sqlite3* db, const std::string& sql) {
+    auto it = index.find(std::string_view(sql));
+    if (it != index.end() && !it->second->checkedOut) {
+        ++hits;
+        List node;
+        node.splice(node.begin(), idle, it->second);
+        node.front().checkedOut = true;
+        return CachedStatement(this, std::move(node), generation);
+    }
+
+    ++misses;
+    List node;
+    node.emplace_back();
+    Entry& entry = node.front();
+    entry.statement = Statement(db, sql, true);
+    if (prepareCheck) {
+        prepareCheck(entry.statement); // a rejected statement is finalized with node
+    }
+    entry.checkedOut = true;
+    if (it != index.end()) {
+        entry.statement.columnMap = it->second->statement.columnMap; // same SQL, same columns
+    }
+    // an entry for the same SQL already checked out stays the cached one, this one is finalized on release
+    if (it == index.end() && capacity > 0) {
+        entry.sql = sql;
+        entry.cached = true;
+        index.emplace(std::string_view(entry.sql), node.begin());
+        evict();
+    }
+    return CachedStatement(this, std::move(node), generation);
+}
+
+void SQLite::StatementCache::release(List& node, uint64_t generation) noexcept {
+    if (node.empty()) {
+        return;
+    }
+    Entry& entry = node.front();
+    if (entry.statement) {
+        // reset first so a failed last step does not surface as a finalize error
+        sqlite3_reset(entry.statement.stmt);
+        sqlite3_clear_bindings(entry.statement.stmt);
+        entry.statement.ownedBindings.clear();
+        entry.statement.batchDone = false;
+    }
+    if (generation != this->generation || !entry.cached || !entry.statement) {
+        node.clear(); // finalize
+        return;
+    }
+    entry.checkedOut = false;
+    idle.splice(idle.begin(), node);
+    evict();
+}
+
+void SQLite::StatementCache::evict() {
+    while (index.size() > capacity && !idle.empty()) {
+        index.erase(std::string_view(idle.back().sql));
+        idle.pop_back();
+        ++evictions;
+    }
+}
+
+void SQLite::StatementCache::setCapacity(size_t capacity) {
+    this->capacity = capacity;
+    evict();
+}
+
+SQLite::StatementCacheStats SQLite::StatementCache::stats() const {
+    StatementCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    stats.size = index.size();
+    stats.capacity = capacity;
+    return stats;
+}
+
+void SQLite::StatementCache::clear() {
+    index.clear();
+    idle.clear();
+    ++generation;
+}
+
+
+bool SQLite::isAutocommit() const {
+    return sqlite3_get_autocommit(db) != 0;
+}
+
+static const char* beginTransactionSQL(SQLite::TransactionMode mode) {
+    switch (mode) {
+        case SQLite::TransactionMode::Immediate:
+            return "BEGIN IMMEDIATE";
+        case SQLite::TransactionMode::Exclusive:
+            return "BEGIN EXCLUSIVE";
+        default:
+            return "BEGIN DEFERRED";
+    }
+}
+
+SQLite::Transaction::Transaction(SQLite& db, TransactionMode mode) {
+    db.prepareCached(beginTransactionSQL(mode))->step();
+    this->db = &db;
+}
+
+SQLite::Transaction::~Transaction() {
+    try {
+        rollback();
+    } catch (...) {
+    }
+}
+
+void SQLite::Transaction::commit() {
+    if (db == nullptr) {
+        throw SQLite::OtherError("transaction is not active");
+    }
+    db->prepareCached("COMMIT")->step(); // stays active if COMMIT fails (e.g. busy), so it can be retried
+    db = nullptr;
+}
+
+void SQLite::Transaction::rollback() {
+    if (db == nullptr) {
+        return;
+    }
+    SQLite* connection = db;
+    db = nullptr;
+    // SQLite may already have rolled back on its own (e.g. SQLITE_FULL, SQLITE_IOERR)
+    if (connection->db && !connection->isAutocommit()) {
+        connection->prepareCached("ROLLBACK")->step();
+    }
+}
+
+static std::string quoteIdentifier(const std::string& name) {
+    std::string quoted = "\"";
+    for (char c : name) {
+        if (c == '"') {
+            quoted += '"';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+SQLite::Savepoint::Savepoint(SQLite& db) : name("sp" + std::to_string(db.savepointDepth + 1)) {
+    db.prepareCached("SAVEPOINT " + name)->step();
+    ++db.savepointDepth;
+    nested = true;
+    this->db = &db;
+}
+
+SQLite::Savepoint::Savepoint(SQLite& db, const std::string& name) : name(quoteIdentifier(name)) {
+    db.prepareCached("SAVEPOINT " + this->name)->step();
+    this->db = &db;
+}
+
+SQLite::Savepoint::~Savepoint() {
+    try {
+        rollback();
+    } catch (...) {
+    }
+}
+
+void SQLite::Savepoint::release() {
+    if (db == nullptr) {
+        throw SQLite::OtherError("savepoint is not active");
+    }
+    db->prepareCached("RELEASE " + name)->step();
+    if (nested) {
+        --db->savepointDepth;
+    }
+    db = nullptr;
+}
+
+void SQLite::Savepoint::rollback() {
+    if (db == nullptr) {
+        return;
+    }
+    SQLite* connection = db;
+    db = nullptr;
+    if (nested) {
+        --connection->savepointDepth;
+    }
+    if (connection->db && !connection->isAutocommit()) {
+        connection->prepareCached("ROLLBACK TO " + name)->step();
+        connection->prepareCached("RELEASE " + name)->step();
+    }
+}
+
+SQLite::BulkInserter::BulkInserter(SQLite& db, const std::string& table, const std::vector<std::string>& columns)
+    : BulkInserter(db, table, columns, BulkInsertOptions()) {}
+
+SQLite::BulkInserter::BulkInserter(SQLite& db, const std::string& table, const std::vector<std::string>& columns,
+        const BulkInsertOptions& options)
+    : db(db), columns(columns.size()), rowsPerStatement(options.rowsPerStatement), rowsPerTransaction(options.rowsPerTransaction) {
+    db.ensure();
+    if (columns.empty()) {
+        throw SQLite::OtherError("bulk insert requires at least one column");
+    }
+
+    // keep rows * columns (+1 for LIMIT) within the bound parameter limit
+    size_t maxVariables = sqlite3_limit(db.db, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+    size_t maxRows = maxVariables > this->columns ? (maxVariables - 1) / this->columns : 1;
+    if (rowsPerStatement < 1) rowsPerStatement = 1;
+    if (rowsPerStatement > maxRows) rowsPerStatement = maxRows;
+
+    std::string columnList;
+    std::string row = "(";
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (i > 0) {
+            columnList += ",";
+            row += ",";
+        }
+        columnList += columns[i];
+        row += "?";
+    }
+    row += ")";
+
+    std::string sql = options.verb + " INTO " + table + " (" + columnList + ") ";
+    if (rowsPerStatement == 1) {
+        sql += "VALUES " + row;
+    } else {
+        // LIMIT lets a partially bound batch insert only its first rows
+        sql += "SELECT * FROM (VALUES " + row;
+        for (size_t i = 1; i < rowsPerStatement; ++i) {
+            sql += "," + row;
+        }
+        sql += ") LIMIT ?";
+    }
+
+    statement = Statement(db.db, sql, true);
+}
+
+void SQLite::BulkInserter::beginRow(size_t values) {
+    if (values != columns) {
+        throw SQLite::OtherError("bulk insert expects " + std::to_string(columns) + " values per row, got " + std::to_string(values));
+    }
+    if (!started) {
+        start = std::chrono::steady_clock::now();
+        started = true;
+        finished = false;
+    }
+    // join the caller's transaction if one is already open
+    if (rowsPerTransaction > 0 && !transaction && db.isAutocommit()) {
+        transaction.emplace(db);
+    }
+}
+
+void SQLite::BulkInserter::endRow() {
+    ++pendingRows;
+    ++transactionRows;
+    if (pendingRows == rowsPerStatement) {
+        stepPending();
+    }
+    if (transaction && transactionRows >= rowsPerTransaction) {
+        commit();
+    }
+}
+
+void SQLite::BulkInserter::stepPending() {
+    if (pendingRows == 0) {
+        return;
+    }
+    if (rowsPerStatement > 1) {
+        statement.bind(static_cast<int>(rowsPerStatement * columns) + 1, static_cast<int64_t>(pendingRows));
+    }
+    size_t rows = pendingRows;
+    pendingRows = 0;
+    try {
+        statement.step();
+    } catch (...) {
+        statement.resetQuietly(); // the rows of the failed step are dropped, later rows can still be inserted
+        transactionRows -= std::min(rows, transactionRows);
+        throw;
+    }
+    statement.reset();
+    counters.rows += rows;
+    ++counters.steps;
+}
+
+void SQLite::BulkInserter::commit() {
+    stepPending();
+    transactionRows = 0;
+    if (transaction) {
+        transaction->commit();
+        transaction.reset();
+        ++counters.transactions;
+    }
+}
+
+void SQLite::BulkInserter::flush() {
+    commit();
+    end = std::chrono::steady_clock::now();
+}
+
+SQLite::BulkInsertStats SQLite::BulkInserter::stats() const {
+    BulkInsertStats stats = counters;
+    if (started) {
+        auto until = finished ? end : std::chrono::steady_clock::now();
+        stats.seconds = std::chrono::duration<double>(until - start).count();
+    }
+    return stats;
+}
+
+
+SQLite::ConnectionPool::ConnectionPool(const std::string& dbName, size_t readers, OpenFlags flags)
+    : ConnectionPool(dbName, readers, flags, OpenOptions()) {}
+
+SQLite::ConnectionPool::ConnectionPool(const std::string& dbName, size_t readers, OpenFlags flags, const OpenOptions& options) {
+    if (!SQLite::isThreadsafe()) {
+        throw SQLite::OtherError("connection pool requires SQLite compiled with thread-safety");
+    }
+    if (readers == 0) {
+        throw SQLite::OtherError("connection pool requires at least one reader");
+    }
+
+    // each connection is used by one thread at a time, so per-connection mutexes are not needed
+    if (!(flags & OpenFlags::FullMutex)) {
+        flags = flags | OpenFlags::NoMutex;
+    }
+
+    OpenOptions writerOptions = options;
+    writerOptions.journalMode = JournalMode::WAL;
+    try {
+        writer = std::make_unique<SQLite>(dbName, flags | OpenFlags::ReadWrite | OpenFlags::Create, writerOptions);
+    } catch (const SQLite::OtherError&) {
+        throw SQLite::OtherError("failed to enable WAL journal mode for database: " + dbName);
+    }
+
+    // journal mode is persistent in the file, page size and checkpointing belong to the writer
+    OpenOptions readerOptions = options;
+    readerOptions.journalMode.reset();
+    readerOptions.pageSize.reset();
+    readerOptions.walAutocheckpoint.reset();
+
+    this->readers.reserve(readers);
+    idleReaders.reserve(readers);
+    for (size_t i = 0; i < readers; ++i) {
+        this->readers.push_back(std::make_unique<SQLite>(dbName, flags | OpenFlags::ReadOnly, readerOptions));
+        idleReaders.push_back(this->readers.back().get());
+    }
+}
+
+SQLite::ConnectionPool::Lease SQLite::ConnectionPool::acquireReader() {
+    std::unique_lock<std::mutex> lock(mutex);
+    readerAvailable.wait(lock, [this] { return !idleReaders.empty(); });
+    SQLite* connection = idleReaders.back();
+    idleReaders.pop_back();
+    return Lease(this, connection, false);
+}
+
+SQLite::ConnectionPool::Lease SQLite::ConnectionPool::acquireWriter() {
+    std::unique_lock<std::mutex> lock(mutex);
+    writerAvailable.wait(lock, [this] { return writerIdle; });
+    writerIdle = false;
+    return Lease(this, writer.get(), true);
+}
+
+SQLite::ConnectionPool::Lease SQLite::ConnectionPool::tryAcquireReader(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!readerAvailable.wait_for(lock, timeout, [this] { return !idleReaders.empty(); })) {
+        return Lease();
+    }
+    SQLite* connection = idleReaders.back();
+    idleReaders.pop_back();
+    return Lease(this, connection, false);
+}
+
+SQLite::ConnectionPool::Lease SQLite::ConnectionPool::tryAcquireWriter(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!writerAvailable.wait_for(lock, timeout, [this] { return writerIdle; })) {
+        return Lease();
+    }
+    writerIdle = false;
+    return Lease(this, writer.get(), true);
+}
+
+void SQLite::ConnectionPool::release(SQLite* connection, bool writer) noexcept {
+    // do not hand out a connection with a transaction left open, it would also hold back checkpoints
+    if (connection->db && !sqlite3_get_autocommit(connection->db)) {
+        sqlite3_exec(connection->db, "ROLLBACK", nullptr, nullptr, nullptr);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (writer) {
+            writerIdle = true;
+        } else {
+            idleReaders.push_back(connection);
+        }
+    }
+    if (writer) {
+        writerAvailable.notify_one();
+    } else {
+        readerAvailable.notify_one();
+    }
+}
+
+
+SQLite::AsyncExecutor::AsyncExecutor(SQLite&& db) : AsyncExecutor(std::move(db), AsyncOptions()) {}
+
+SQLite::AsyncExecutor::AsyncExecutor(SQLite&& db, const AsyncOptions& options)
+    : db(std::make_unique<SQLite>(std::move(db))), options(options) {
+    worker = std::thread([this] { run(); });
+}
+
+SQLite::AsyncExecutor::~AsyncExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void SQLite::AsyncExecutor::enqueue(Task* task) {
+    push(task);
+    // pairs with the worker setting sleeping before its last look at the queue
+    if (sleeping.load()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_one();
+    }
+}
+
+void SQLite::AsyncExecutor::push(Task* task) {
+    task->next.store(nullptr, std::memory_order_relaxed);
+    Task* previous = head.exchange(task, std::memory_order_acq_rel);
+    previous->next.store(task);
+}
+
+SQLite::AsyncExecutor::Task* SQLite::AsyncExecutor::pop() {
+    Task* first = tail;
+    Task* next = first->next.load();
+    if (first == &stub) {
+        if (next == nullptr) {
+            return nullptr;
+        }
+        tail = next;
+        first = next;
+        next = next->next.load();
+    }
+    if (next) {
+        tail = next;
+        return first;
+    }
+    if (first != head.load()) {
+        return nullptr; // a producer is between exchange and link, it wakes the worker when done
+    }
+    push(&stub);
+    next = first->next.load();
+    if (next) {
+        tail = next;
+        return first;
+    }
+    return nullptr;
+}
+
+void SQLite::AsyncExecutor::run() {
+    std::unique_ptr<Task> deferred; // popped while collecting a write group, runs next
+    while (true) {
+        std::unique_ptr<Task> task = deferred ? std::move(deferred) : std::unique_ptr<Task>(pop());
+        if (!task) {
+            std::unique_lock<std::mutex> lock(mutex);
+            sleeping = true;
+            while ((task = std::unique_ptr<Task>(pop())) == nullptr && !stopping) {
+                wake.wait(lock);
+            }
+            sleeping = false;
+            if (!task) {
+                return; // stopping and drained
+            }
+        }
+
+        if (task->write && options.groupWrites && options.maxWriteGroup > 1 && db->isAutocommit()) {
+            std::vector<std::unique_ptr<Task>> group;
+            group.push_back(std::move(task));
+            while (group.size() < options.maxWriteGroup) {
+                std::unique_ptr<Task> next(pop());
+                if (!next) {
+                    break;
+                }
+                if (!next->write) {
+                    deferred = std::move(next);
+                    break;
+                }
+                group.push_back(std::move(next));
+            }
+            if (group.size() > 1) {
+                runWriteGroup(group);
+                continue;
+            }
+            task = std::move(group.front());
+        }
+
+        task->run(*db);
+        task->complete();
+    }
+}
+
+void SQLite::AsyncExecutor::runWriteGroup(std::vector<std::unique_ptr<Task>>& group) {
+    size_t ran = 0; // tasks run inside the transaction
+    std::exception_ptr lost; // set if a task ended the whole transaction
+    try {
+        Transaction transaction(*db, TransactionMode::Immediate);
+        while (ran < group.size()) {
+            Task& task = *group[ran++];
+            Savepoint savepoint(*db);
+            task.run(*db);
+            if (db->isAutocommit()) {
+                // INSERT OR ROLLBACK, RAISE(ROLLBACK), SQLITE_FULL, an interrupt, ... rolled back everything so far
+                lost = task.error ? task.error : std::make_exception_ptr(OtherError("transaction ended by a grouped write"));
+                break;
+            }
+            if (task.error) {
+                savepoint.rollback(); // only this write is undone, its error is published below
+            } else {
+                savepoint.release();
+            }
+        }
+        if (!lost) {
+            transaction.commit();
+        }
+    } catch (...) {
+        // BEGIN, a savepoint or COMMIT failed, nothing in the group was committed
+        auto error = std::current_exception();
+        for (auto& task : group) {
+            task->fail(error);
+        }
+        return;
+    }
+    if (!lost) {
+        for (auto& task : group) {
+            task->complete();
+        }
+        return;
+    }
+
+    // the earlier writes were rolled back with the transaction, the one that ended it reports its own outcome
+    for (size_t i = 0; i + 1 < ran; ++i) {
+        group[i]->fail(lost);
+    }
+    group[ran - 1]->complete();
+
+    // the rest has not run yet
+    std::vector<std::unique_ptr<Task>> rest(std::make_move_iterator(group.begin() + ran), std::make_move_iterator(group.end()));
+    if (rest.size() > 1) {
+        runWriteGroup(rest);
+    } else if (rest.size() == 1) {
+        rest.front()->run(*db);
+        rest.front()->complete();
+    }
+}
+
+SQLite::BlobStream::BlobStream(SQLite& db, const std::string& table, const std::string& column, int64_t rowid, bool writable,
+        const std::string& database) {
+    db.ensure();
+    if (sqlite3_blob_open(db.db, database.c_str(), table.c_str(), column.c_str(), rowid, writable ? 1 : 0, &blob) != SQLITE_OK) {
+        blob = nullptr; // sqlite3_blob_open sets it to nullptr on most, not all, errors
+        throwSQLiteError(db.db, "failed to open blob");
+    }
+    this->db = db.db;
+}
+
+SQLite::BlobStream::~BlobStream() {
+    close();
+}
+
+SQLite::BlobStream& SQLite::BlobStream::operator=(BlobStream&& other) noexcept {
+    if (this != &other) {
+        close();
+        db = other.db;
+        blob = other.blob;
+        other.blob = nullptr;
+    }
+    return *this;
+}
+
+int SQLite::BlobStream::size() const {
+    ensure();
+    return sqlite3_blob_bytes(blob);
+}
+
+void SQLite::BlobStream::read(void* buffer, int size, int offset) const {
+    ensure();
+    if (sqlite3_blob_read(blob, buffer, size, offset) != SQLITE_OK) {
+        throwSQLiteError(db, "failed to read blob");
+    }
+}
+
+void SQLite::BlobStream::write(const void* data, int size, int offset) {
+    ensure();
+    if (sqlite3_blob_write(blob, data, size, offset) != SQLITE_OK) {
+        throwSQLiteError(db, "failed to write blob");
+    }
+}
+
+void SQLite::BlobStream::reopen(int64_t rowid) {
+    ensure();
+    if (sqlite3_blob_reopen(blob, rowid) != SQLITE_OK) {
+        throwSQLiteError(db, "failed to reopen blob");
+    }
+}
+
+void SQLite::BlobStream::close() {
+    if (blob) {
+        // errors are reported by the failing read/write, sqlite3_blob_close always releases the handle
+        sqlite3_blob_close(blob);
+        blob = nullptr;
+    }
+}
+
+
+
+SQLite::Backup::Backup(SQLite& destination, SQLite& source, const std::string& destinationName, const std::string& sourceName) {
+    destination.ensure();
+    source.ensure();
+    backup = sqlite3_backup_init(destination.db, destinationName.c_str(), source.db, sourceName.c_str());
+    if (!backup) {
+        throwSQLiteError(destination.db, "failed to start backup"); // errors are stored on the destination
+    }
+    this->destination = destination.db;
+}
+
+SQLite::Backup::~Backup() {
+    if (backup) {
+        sqlite3_backup_finish(backup);
+    }
+}
+
+bool SQLite::Backup::step(int pages) {
+    ensure();
+    if (done) {
+        return true;
+    }
+    int result = sqlite3_backup_step(backup, pages);
+    switch (result) {
+    case SQLITE_DONE:
+        done = true;
+        return true;
+    case SQLITE_OK:
+    case SQLITE_BUSY:
+    case SQLITE_LOCKED:
+        return false; // pages left or the source is locked, retry later
+    default: {
+        // the error code is returned by sqlite3_backup_finish, which also ends the backup
+        sqlite3_backup* failed = backup;
+        backup = nullptr;
+        sqlite3_backup_finish(failed);
+        throwSQLiteError(destination, "backup step failed");
+        return false;
+    }
+    }
+}
+
+void SQLite::Backup::run(int pagesPerStep, std::chrono::milliseconds pause, const std::function<bool(int, int)>& progress) {
+    while (!step(pagesPerStep)) {
+        if (progress && !progress(remaining(), pageCount())) {
+            return;
+        }
+        if (pause.count() > 0) {
+            std::this_thread::sleep_for(pause);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    if (progress) {
+        progress(0, pageCount());
+    }
+}
+
+int SQLite::Backup::remaining() const {
+    ensure();
+    return sqlite3_backup_remaining(backup);
+}
+
+int SQLite::Backup::pageCount() const {
+    ensure();
+    return sqlite3_backup_pagecount(backup);
+}
+
+void SQLite::Backup::finish() {
+    ensure();
+    sqlite3_backup* finished = backup;
+    backup = nullptr;
+    if (sqlite3_backup_finish(finished) != SQLITE_OK) {
+        throwSQLiteError(destination, "backup failed");
+    }
+}
+
+std::vector<std::byte> SQLite::serialize(const std::string& schema) const {
+    ensure();
+    sqlite3_int64 size = 0;
+    // in-memory databases are contiguous, read them in place
+    const unsigned char* data = sqlite3_serialize(db, schema.c_str(), &size, SQLITE_SERIALIZE_NOCOPY);
+    if (data) {
+        auto bytes = reinterpret_cast<const std::byte*>(data);
+        return std::vector<std::byte>(bytes, bytes + size);
+    }
+    unsigned char* copy = sqlite3_serialize(db, schema.c_str(), &size, 0);
+    if (!copy) {
+        if (size == 0 && sqlite3_errcode(db) == SQLITE_OK) {
+            return {}; // empty database
+        }
+        throwSQLiteError(db, "failed to serialize " + schema);
+    }
+    auto bytes = reinterpret_cast<const std::byte*>(copy);
+    std::vector<std::byte> result(bytes, bytes + size);
+    sqlite3_free(copy);
+    return result;
+}
+
+void SQLite::deserialize(const void* data, size_t size, const std::string& schema, bool readOnly) {
+    ensure();
+    auto* buffer = static_cast<unsigned char*>(sqlite3_malloc64(size > 0 ? size : 1));
+    if (!buffer) {
+        throw std::bad_alloc();
+    }
+    if (size > 0) {
+        std::memcpy(buffer, data, size);
+    }
+    unsigned flags = SQLITE_DESERIALIZE_FREEONCLOSE | (readOnly ? SQLITE_DESERIALIZE_READONLY : SQLITE_DESERIALIZE_RESIZEABLE);
+    // buffer is freed by SQLite on failure too
+    if (sqlite3_deserialize(db, schema.c_str(), buffer, size, size, flags) != SQLITE_OK) {
+        throwSQLiteError(db, "failed to deserialize " + schema);
+    }
+}
+
+
+SQLite::CheckpointScheduler::CheckpointScheduler(SQLite& writer) : CheckpointScheduler(writer, CheckpointPolicy()) {}
+
+SQLite::CheckpointScheduler::CheckpointScheduler(SQLite& writer, const CheckpointPolicy& policy)
+        : writer(writer.db), policy(policy), autocheckpoint(0) {
+    writer.ensure();
+    const char* fileName = sqlite3_db_filename(writer.db, policy.schema.c_str());
+    if (!fileName || !*fileName) {
+        throw SQLite::OtherError("checkpoint scheduler requires a file database: " + policy.schema);
+    }
+    if (sqlite3_db_readonly(writer.db, policy.schema.c_str()) != 0) {
+        throw SQLite::OtherError("checkpoint scheduler requires a writable database: " + policy.schema);
+    }
+    autocheckpoint = static_cast<int>(writer.pragmaInt("wal_autocheckpoint"));
+
+    connection = std::make_unique<SQLite>(fileName, OpenFlags::ReadWrite);
+    connection->setBusyTimeout(policy.busyTimeout);
+    {
+        // also makes the connection read the database, checkpoints of a connection that has not are no-ops
+        Statement pragma(connection->db, "PRAGMA " + quoteIdentifier(policy.schema) + ".journal_mode");
+        if (!pragma.step() || pragma.getString(0) != "wal") {
+            throw SQLite::OtherError("checkpoint scheduler requires WAL journal mode: " + policy.schema);
+        }
+    }
+
+    worker = std::thread([this] { work(); });
+    sqlite3_wal_hook(this->writer, &CheckpointScheduler::walHook, this);
+}
+
+SQLite::CheckpointScheduler::~CheckpointScheduler() {
+    sqlite3_wal_autocheckpoint(writer, autocheckpoint); // also removes walHook
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+void SQLite::CheckpointScheduler::requestCheckpoint() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requested = true;
+    }
+    wake.notify_all();
+}
+
+SQLite::CheckpointStats SQLite::CheckpointScheduler::stats() const {
+    CheckpointStats stats;
+    stats.walFrames = walFrames;
+    stats.maxWalFrames = maxWalFrames;
+    stats.checkpoints = checkpoints;
+    stats.busy = busy;
+    stats.failures = failures;
+    stats.framesCheckpointed = framesCheckpointed;
+    stats.lastMicros = lastMicros;
+    stats.maxMicros = maxMicros;
+    stats.totalMicros = totalMicros;
+    return stats;
+}
+
+int SQLite::CheckpointScheduler::walHook(void* context, sqlite3*, const char* schema, int frames) {
+    auto* scheduler = static_cast<CheckpointScheduler*>(context);
+    if (scheduler->policy.schema != schema) {
+        return SQLITE_OK;
+    }
+    // called by the writer after each commit, only signal the scheduler thread
+    scheduler->walFrames = frames;
+    if (frames > scheduler->maxWalFrames) {
+        scheduler->maxWalFrames = frames;
+    }
+    // frames not copied yet, the WAL may also keep growing while readers prevent it from starting over
+    int last = scheduler->lastCheckpointed;
+    int pending = frames >= last ? frames - last : frames;
+    if (scheduler->policy.walFrames > 0 && pending >= scheduler->policy.walFrames) {
+        scheduler->requestCheckpoint();
+    }
+    return SQLITE_OK;
+}
+
+void SQLite::CheckpointScheduler::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        auto ready = [this] { return stopping || requested; };
+        bool triggered;
+        if (policy.interval.count() > 0) {
+            triggered = wake.wait_for(lock, policy.interval, ready);
+        } else {
+            wake.wait(lock, ready);
+            triggered = true;
+        }
+        if (stopping) {
+            break;
+        }
+        if (!triggered && walFrames == 0) {
+            continue; // interval elapsed, nothing written since the last checkpoint
+        }
+        requested = false;
+        lock.unlock();
+        checkpoint();
+        lock.lock();
+    }
+}
+
+void SQLite::CheckpointScheduler::checkpoint() {
+    static const int modes[] = {
+        SQLITE_CHECKPOINT_PASSIVE, SQLITE_CHECKPOINT_FULL, SQLITE_CHECKPOINT_RESTART, SQLITE_CHECKPOINT_TRUNCATE
+    };
+    int logFrames = 0;
+    int checkpointed = 0;
+    int frames = walFrames;
+    auto start = std::chrono::steady_clock::now();
+    int result = sqlite3_wal_checkpoint_v2(connection->db, policy.schema.c_str(), modes[static_cast<int>(policy.mode)],
+            &logFrames, &checkpointed);
+    auto micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+
+    ++checkpoints;
+    lastMicros = micros;
+    totalMicros += micros;
+    if (micros > maxMicros) {
+        maxMicros = micros;
+    }
+    if (result == SQLITE_OK && policy.mode == CheckpointMode::Truncate) {
+        logFrames = checkpointed = frames; // a truncated WAL reports 0 frames
+    }
+    if (result == SQLITE_BUSY || (result == SQLITE_OK && checkpointed < logFrames)) {
+        ++busy;
+    } else if (result != SQLITE_OK) {
+        ++failures;
+    }
+    if (checkpointed > 0) {
+        // counts are for the whole WAL, which only starts over once a writer restarts it
+        int copied = checkpointed >= lastCheckpointed ? checkpointed - lastCheckpointed : checkpointed;
+        framesCheckpointed += static_cast<uint64_t>(copied);
+    }
+    lastCheckpointed = policy.mode == CheckpointMode::Truncate ? 0 : std::max(checkpointed, 0);
+    if (result == SQLITE_OK && checkpointed == logFrames) {
+        walFrames = 0; // fully copied, the next writer may restart the WAL
+    }
+}
+
+
+SQLite::Script::Script(SQLite& db, const std::string& sql) : db(db.db), source(sql) {
+    db.ensure();
+    while (prepareNext(true)) {}
+}
+
+bool SQLite::Script::prepareNext(bool deferErrors) {
+    const char* begin = source.c_str();
+    const char* end = begin + source.size();
+    while (position < source.size()) {
+        const char* start = begin + position;
+        sqlite3_stmt* stmt = nullptr;
+        const char* tail = nullptr;
+        if (sqlite3_prepare_v3(db, start, static_cast<int>(end - start), SQLITE_PREPARE_PERSISTENT, &stmt, &tail) != SQLITE_OK) {
+            if (deferErrors) {
+                return false; // may depend on the statements before it, prepared again once those ran
+            }
+            int offset = sqlite3_error_offset(db);
+            if (offset > -1) {
+                // offsets are relative to the statement being prepared
+                throw SQLite::SyntaxError("failed to prepare script", sqlite3_errmsg(db), sqlite3_errcode(db),
+                        sqlite3_extended_errcode(db), source, static_cast<int>(position) + offset);
+            }
+            throwSQLiteError(db, "failed to prepare script");
+        }
+        position = tail == start ? source.size() : static_cast<size_t>(tail - begin);
+        if (stmt) { // nullptr for whitespace and comments
+            size_t index = statements.size();
+            statements.push_back(Statement(stmt));
+            ranges.emplace_back(start - begin, tail - start);
+            int count = sqlite3_bind_parameter_count(stmt);
+            for (int i = 1; i <= count; ++i) {
+                if (const char* name = sqlite3_bind_parameter_name(stmt, i)) {
+                    parameters[name].emplace_back(index, i);
+                    auto deferred = deferredBindings.find(name);
+                    if (deferred != deferredBindings.end()) {
+                        deferred->second(statements.back(), i);
+                    }
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view SQLite::Script::sql(size_t index) const {
+    const auto& range = ranges.at(index);
+    return std::string_view(source).substr(range.first, range.second);
+}
+
+const std::vector<std::pair<size_t, int>>& SQLite::Script::parameterIndices(const std::string& name) const {
+    static const std::vector<std::pair<size_t, int>> none;
+    auto it = parameters.find(name);
+    if (it == parameters.end()) {
+        if (position < source.size()) {
+            return none; // may be used by a statement not prepared yet
+        }
+        throw SQLite::OtherError("parameter not found: " + name);
+    }
+    return it->second;
+}
+
+void SQLite::Script::resetQuietly(Statement& statement) noexcept {
+    sqlite3_reset(statement.stmt);
+}
+
+void SQLite::Script::execute() {
+    execute([](size_t, Statement&) {});
+}
+
+void SQLite::Script::clearBindings() {
+    for (auto& statement : statements) {
+        statement.clearBindings();
+    }
+    deferredBindings.clear();
+}
+
+#if defined(SQLITE_ENABLE_SNAPSHOT)
+
+// the snapshot functions return their error without recording it on the connection
+static void throwSnapshotError(int result, const std::string& message) {
+    if ((result & 0xff) == SQLITE_BUSY) {
+        throw SQLite::BusyError(message, sqlite3_errstr(result), result & 0xff, result);
+    }
+    throw SQLite::Error(message, sqlite3_errstr(result), result & 0xff, result);
+}
+
+SQLite::Snapshot::~Snapshot() {
+    sqlite3_snapshot_free(snapshot); // no-op for nullptr
+}
+
+SQLite::Snapshot& SQLite::Snapshot::operator=(Snapshot&& other) noexcept {
+    if (this != &other) {
+        sqlite3_snapshot_free(snapshot);
+        snapshot = other.snapshot;
+        other.snapshot = nullptr;
+    }
+    return *this;
+}
+
+int SQLite::Snapshot::compare(const Snapshot& other) const {
+    if (!snapshot || !other.snapshot) {
+        throw OtherError("snapshot is empty");
+    }
+    return sqlite3_snapshot_cmp(snapshot, other.snapshot);
+}
+
+SQLite::Snapshot SQLite::takeSnapshot(const std::string& schema) {
+    ensure();
+    std::optional<Transaction> transaction;
+    if (isAutocommit()) {
+        transaction.emplace(*this); // sqlite3_snapshot_get() starts the read itself, but not outside a transaction
+    }
+    sqlite3_snapshot* snapshot = nullptr;
+    int result = sqlite3_snapshot_get(db, schema.c_str(), &snapshot);
+    if (result != SQLITE_OK) {
+        throwSnapshotError(result, "failed to take snapshot of " + schema);
+    }
+    Snapshot taken(snapshot);
+    if (transaction) {
+        transaction->commit();
+    }
+    return taken;
+}
+
+SQLite::Transaction SQLite::beginTransaction(const Snapshot& snapshot, const std::string& schema) {
+    ensure();
+    if (!snapshot) {
+        throw OtherError("snapshot is empty");
+    }
+    // a connection that has not read the database yet does not know it is in WAL mode and fails to open snapshots
+    prepareCached("PRAGMA " + quoteIdentifier(schema) + ".application_id")->step();
+    Transaction transaction(*this);
+    openSnapshot(snapshot, schema); // transaction is rolled back if this throws
+    return transaction;
+}
+
+void SQLite::openSnapshot(const Snapshot& snapshot, const std::string& schema) {
+    int result = sqlite3_snapshot_open(db, schema.c_str(), snapshot.snapshot);
+    if (result != SQLITE_OK) {
+        throwSnapshotError(result, "failed to open snapshot of " + schema);
+    }
+}
+
+void SQLite::recoverSnapshots(const std::string& schema) {
+    ensure();
+    int result = sqlite3_snapshot_recover(db, schema.c_str());
+    if (result != SQLITE_OK) {
+        throwSnapshotError(result, "failed to recover snapshots of " + schema);
+    }
+}
+
+SQLite::Snapshot SQLite::ConnectionPool::takeSnapshot() {
+    Lease lease = acquireReader();
+    return lease->takeSnapshot();
+}
+
+SQLite::ConnectionPool::Lease SQLite::ConnectionPool::acquireReader(const Snapshot& snapshot) {
+    if (!snapshot) {
+        throw OtherError("snapshot is empty");
+    }
+    Lease lease = acquireReader();
+    // as SQLite::beginTransaction(snapshot), but the transaction ends with the lease: release() rolls it back
+    lease->prepareCached("PRAGMA main.application_id")->step();
+    lease->prepareCached("BEGIN")->step();
+    lease->openSnapshot(snapshot, "main");
+    return lease;
+}
+
+#endif // SQLITE_ENABLE_SNAPSHOT
+
+#if defined(SQLITE_ENABLE_SESSION)
+
+namespace {
+
+std::vector<std::byte> takeSessionBuffer(void* data, int size) {
+    auto bytes = static_cast<const std::byte*>(data);
+    std::vector<std::byte> result(bytes, bytes + size);
+    sqlite3_free(data);
+    return result;
+}
+
+int streamOutput(void* context, const void* data, int size) {
+    try {
+        (*static_cast<const std::function<void(const void*, size_t)>*>(context))(data, static_cast<size_t>(size));
+        return SQLITE_OK;
+    } catch (...) {
+        return SQLITE_ABORT; // stops the stream, reported as an error below
+    }
+}
+
+std::unique_ptr<SQLite::Error> sessionError(int result, const std::string& message) {
+    return std::make_unique<SQLite::Error>(message, sqlite3_errstr(result), result, result);
+}
+
+} // namespace
+
+SQLite::Session::Session(SQLite& db, const std::string& schema) {
+    db.ensure();
+    int result = sqlite3session_create(db.db, schema.c_str(), &session);
+    if (result != SQLITE_OK) {
+        throw *sessionError(result, "failed to create session");
+    }
+}
+
+SQLite::Session::~Session() {
+    if (session) {
+        sqlite3session_delete(session);
+    }
+}
+
+void SQLite::Session::attach(const std::string& table) {
+    int result = sqlite3session_attach(session, table.c_str());
+    if (result != SQLITE_OK) {
+        throw *sessionError(result, "failed to attach session to " + table);
+    }
+}
+
+void SQLite::Session::attachAll() {
+    int result = sqlite3session_attach(session, nullptr);
+    if (result != SQLITE_OK) {
+        throw *sessionError(result, "failed to attach session to all tables");
+    }
+}
+
+void SQLite::Session::setEnabled(bool enabled) {
+    sqlite3session_enable(session, enabled ? 1 : 0);
+}
+
+bool SQLite::Session::isEnabled() const {
+    return sqlite3session_enable(session, -1) != 0;
+}
+
+bool SQLite::Session::isEmpty() const {
+    return sqlite3session_isempty(session) != 0;
+}
+
+std::vector<std::byte> SQLite::Session::changeset() const {
+    int size = 0;
+    void* data = nullptr;
+    int result = sqlite3session_changeset(session, &size, &data);
+    if (result != SQLITE_OK) {
+        throw *sessionError(result, "failed to create changeset");
+    }
+    return takeSessionBuffer(data, size);
+}
+
+std::vector<std::byte> SQLite::Session::patchset() const {
+    int size = 0;
+    void* data = nullptr;
+    int result = sqlite3session_patchset(session, &size, &data);
+    if (result != SQLITE_OK) {
+        throw *sessionError(result, "failed to create patchset");
+    }
+    return takeSessionBuffer(data, size);
+}
+
+void SQLite::Session::changeset(const std::function<void(const void*, size_t)>& output) const {
+    int result = sqlite3session_changeset_strm(session, streamOutput, const_cast<std::function<void(const void*, size_t)>*>(&output));
+    if (result != SQLITE_OK) {
+        throw *sessionError(result, "failed to stream changeset");
+    }
+}
+
+void SQLite::Session::patchset(const std::function<void(const void*, size_t)>& output) const {
+    int result = sqlite3session_patchset_strm(session, streamOutput, const_cast<std::function<void(const void*, size_t)>*>(&output));
+    if (result != SQLITE_OK) {
+        throw *sessionError(result, "failed to stream patchset");
+    }
+}
+
+void SQLite::applyChangeset(const std::vector<std::byte>& changeset,
+        const std::function<ConflictAction(ChangesetConflict, std::string_view)>& onConflict) {
+    ensure();
+    struct Context {
+        const std::function<ConflictAction(ChangesetConflict, std::string_view)>& onConflict;
+        std::exception_ptr error;
+    } context{onConflict, nullptr};
+
+    auto conflict = [](void* data, int type, sqlite3_changeset_iter* iterator) -> int {
+        auto& context = *static_cast<Context*>(data);
+        if (!context.onConflict) {
+            return SQLITE_CHANGESET_OMIT;
+        }
+        ChangesetConflict conflict;
+        switch (type) {
+            case SQLITE_CHANGESET_DATA: conflict = ChangesetConflict::Data; break;
+            case SQLITE_CHANGESET_NOTFOUND: conflict = ChangesetConflict::NotFound; break;
+            case SQLITE_CHANGESET_CONFLICT: conflict = ChangesetConflict::Conflict; break;
+            case SQLITE_CHANGESET_CONSTRAINT: conflict = ChangesetConflict::Constraint; break;
+            default: conflict = ChangesetConflict::ForeignKey; break;
+        }
+        const char* table = nullptr;
+        int columns = 0;
+        int operation = 0;
+        sqlite3changeset_op(iterator, &table, &columns, &operation, nullptr);
+        try {
+            switch (context.onConflict(conflict, table ? table : "")) {
+                case ConflictAction::Omit: return SQLITE_CHANGESET_OMIT;
+                case ConflictAction::Replace: return SQLITE_CHANGESET_REPLACE;
+                case ConflictAction::Abort: return SQLITE_CHANGESET_ABORT;
+            }
+        } catch (...) {
+            context.error = std::current_exception();
+        }
+        return SQLITE_CHANGESET_ABORT;
+    };
+
+    int result = sqlite3changeset_apply(db, static_cast<int>(changeset.size()), const_cast<std::byte*>(changeset.data()),
+            nullptr, conflict, &context);
+    if (context.error) {
+        std::rethrow_exception(context.error);
+    }
+    if (result == SQLITE_ABORT) {
+        throw *sessionError(result, "changeset aborted on conflict"); // the connection holds no error for this
+    }
+    if (result != SQLITE_OK) {
+        throwSQLiteError(db, "failed to apply changeset");
+    }
+}
+
+std::vector<std::byte> SQLite::invertChangeset(const std::vector<std::byte>& changeset) {
+    int size = 0;
+    void* data = nullptr;
+    int result = sqlite3changeset_invert(static_cast<int>(changeset.size()), changeset.data(), &size, &data);
+    if (result != SQLITE_OK) {
+        throw *sessionError(result, "failed to invert changeset");
+    }
+    return takeSessionBuffer(data, size);
+}
+
+#endif // SQLITE_ENABLE_SESSION
+
+
+// read-only virtual tables over C++ ranges, eponymous: usable by module name without CREATE VIRTUAL TABLE
+
+SQLite::DataType SQLite::valueType(sqlite3_value* value) {
+    switch (sqlite3_value_type(value)) {
+        case SQLITE_INTEGER: return DataType::Integer;
+        case SQLITE_FLOAT: return DataType::Float;
+        case SQLITE_TEXT: return DataType::Text;
+        case SQLITE_BLOB: return DataType::Blob;
+        default: return DataType::Null;
+    }
+}
+
+struct SQLite::VirtualModule {
+    struct Table : sqlite3_vtab {
+        const VirtualTableSource* source;
+    };
+
+    struct Cursor : sqlite3_vtab_cursor {
+        std::unique_ptr<VirtualCursor> cursor;
+    };
+
+    static const sqlite3_module& module() {
+        static const sqlite3_module module = [] {
+            sqlite3_module m;
+            std::memset(&m, 0, sizeof(m));
+            m.xConnect = connect; // without xCreate the table is eponymous-only
+            m.xBestIndex = bestIndex;
+            m.xDisconnect = disconnect;
+            m.xOpen = open;
+            m.xClose = close;
+            m.xFilter = filter;
+            m.xNext = next;
+            m.xEof = eof;
+            m.xColumn = column;
+            m.xRowid = rowid;
+            return m;
+        }();
+        return module;
+    }
+
+    static int fail(sqlite3_vtab* table, const char* message) {
+        sqlite3_free(table->zErrMsg);
+        table->zErrMsg = sqlite3_mprintf("%s", message);
+        return SQLITE_ERROR;
+    }
+
+    static int connect(sqlite3* db, void* data, int, const char* const*, sqlite3_vtab** result, char** error) {
+        auto* source = static_cast<const VirtualTableSource*>(data);
+        std::string sql = "CREATE TABLE x(";
+        for (size_t i = 0; i < source->columns.size(); ++i) {
+            static const char* types[] = {"INTEGER", "REAL", "TEXT", "BLOB", ""};
+            sql += (i > 0 ? ", " : "") + quoteIdentifier(source->columns[i].name) + " "
+                    + types[static_cast<int>(source->columns[i].type)];
+        }
+        sql += ")";
+        int status = sqlite3_declare_vtab(db, sql.c_str());
+        if (status != SQLITE_OK) {
+            *error = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+            return status;
+        }
+        auto* table = new (std::nothrow) Table();
+        if (!table) {
+            return SQLITE_NOMEM;
+        }
+        table->source = source;
+        *result = table;
+        return SQLITE_OK;
+    }
+
+    static int disconnect(sqlite3_vtab* table) {
+        delete static_cast<Table*>(table);
+        return SQLITE_OK;
+    }
+
+    // text keys are ordered and looked up in BINARY order, constraints with another collation (NOCASE, RTRIM)
+    // match rows outside that range and must be left to SQLite
+    static bool usable(const VirtualTableSource& source, sqlite3_index_info* info, int i) {
+        const auto& constraint = info->aConstraint[i];
+        if (!constraint.usable) {
+            return false;
+        }
+        if (source.columns[constraint.iColumn].type != DataType::Text) {
+            return true;
+        }
+        const char* collation = sqlite3_vtab_collation(info, i);
+        return !collation || sqlite3_stricmp(collation, "BINARY") == 0;
+    }
+
+    // picks the key column whose usable constraints are cheapest, idxNum = column + 1 (0 for a full scan) and
+    // idxStr one operator per argument: e (=), g (>), G (>=), l (<), L (<=)
+    static int bestIndex(sqlite3_vtab* vtab, sqlite3_index_info* info) {
+        const VirtualTableSource& source = *static_cast<Table*>(vtab)->source;
+        double rows = std::max(source.estimatedRows(), 1.0);
+        double search = std::log2(rows + 1);
+
+        int best = -1;
+        double bestCost = rows;
+        double bestRows = rows;
+        for (size_t column = 0; column < source.columns.size(); ++column) {
+            VirtualKey key = source.columns[column].key;
+            if (key == VirtualKey::None) {
+                continue;
+            }
+            bool equal = false;
+            bool lower = false;
+            bool upper = false;
+            for (int i = 0; i < info->nConstraint; ++i) {
+                const auto& constraint = info->aConstraint[i];
+                if (constraint.iColumn != static_cast<int>(column) || !usable(source, info, i)) {
+                    continue;
+                }
+                switch (constraint.op) {
+                    case SQLITE_INDEX_CONSTRAINT_EQ: equal = true; break;
+                    case SQLITE_INDEX_CONSTRAINT_GT: case SQLITE_INDEX_CONSTRAINT_GE: lower = lower || key == VirtualKey::Sorted; break;
+                    case SQLITE_INDEX_CONSTRAINT_LT: case SQLITE_INDEX_CONSTRAINT_LE: upper = upper || key == VirtualKey::Sorted; break;
+                }
+            }
+            double cost;
+            double estimate;
+            if (equal) {
+                estimate = 1;
+                cost = key == VirtualKey::Lookup ? 1 : search;
+            } else if (lower || upper) {
+                estimate = lower && upper ? rows / 16 : rows / 4;
+                cost = 2 * search + estimate;
+            } else {
+                continue;
+            }
+            if (cost < bestCost) {
+                best = static_cast<int>(column);
+                bestCost = cost;
+                bestRows = estimate;
+            }
+        }
+
+        std::string operators;
+        if (best >= 0) {
+            VirtualKey key = source.columns[best].key;
+            for (int i = 0; i < info->nConstraint; ++i) {
+                const auto& constraint = info->aConstraint[i];
+                if (constraint.iColumn != best || !usable(source, info, i)) {
+                    continue;
+                }
+                char op = 0;
+                switch (constraint.op) {
+                    case SQLITE_INDEX_CONSTRAINT_EQ: op = 'e'; break;
+                    case SQLITE_INDEX_CONSTRAINT_GT: op = 'g'; break;
+                    case SQLITE_INDEX_CONSTRAINT_GE: op = 'G'; break;
+                    case SQLITE_INDEX_CONSTRAINT_LT: op = 'l'; break;
+                    case SQLITE_INDEX_CONSTRAINT_LE: op = 'L'; break;
+                }
+                if (op == 0 || (key == VirtualKey::Lookup && op != 'e')) {
+                    continue;
+                }
+                operators += op;
+                info->aConstraintUsage[i].argvIndex = static_cast<int>(operators.size());
+                info->aConstraintUsage[i].omit = 0; // SQLite re-checks, types may differ
+            }
+            info->idxStr = sqlite3_mprintf("%s", operators.c_str());
+            if (!info->idxStr) {
+                return SQLITE_NOMEM;
+            }
+            info->needToFreeIdxStr = 1;
+        }
+        info->idxNum = best + 1;
+        info->estimatedCost = bestCost;
+        info->estimatedRows = static_cast<sqlite3_int64>(bestRows);
+
+        // ascending ORDER BY a sorted column comes for free unless a lookup decides the order
+        if (info->nOrderBy == 1 && !info->aOrderBy[0].desc && info->aOrderBy[0].iColumn >= 0
+                && source.columns[info->aOrderBy[0].iColumn].key == VirtualKey::Sorted
+                && (best < 0 || source.columns[best].key == VirtualKey::Sorted)) {
+            info->orderByConsumed = 1;
+        }
+        return SQLITE_OK;
+    }
+
+    static int open(sqlite3_vtab* vtab, sqlite3_vtab_cursor** result) {
+        auto* cursor = new (std::nothrow) Cursor();
+        if (!cursor) {
+            return SQLITE_NOMEM;
+        }
+        try {
+            cursor->cursor = static_cast<Table*>(vtab)->source->open();
+        } catch (const std::exception& e) {
+            delete cursor;
+            return fail(vtab, e.what());
+        }
+        *result = cursor;
+        return SQLITE_OK;
+    }
+
+    static int close(sqlite3_vtab_cursor* cursor) {
+        delete static_cast<Cursor*>(cursor);
+        return SQLITE_OK;
+    }
+
+    static int filter(sqlite3_vtab_cursor* cursor, int index, const char* operators, int, sqlite3_value** values) {
+        try {
+            static_cast<Cursor*>(cursor)->cursor->filter(index - 1, operators ? operators : "", values);
+            return SQLITE_OK;
+        } catch (const std::exception& e) {
+            return fail(cursor->pVtab, e.what());
+        }
+    }
+
+    static int next(sqlite3_vtab_cursor* cursor) {
+        try {
+            static_cast<Cursor*>(cursor)->cursor->next();
+            return SQLITE_OK;
+        } catch (const std::exception& e) {
+            return fail(cursor->pVtab, e.what());
+        }
+    }
+
+    static int eof(sqlite3_vtab_cursor* cursor) {
+        return static_cast<Cursor*>(cursor)->cursor->eof() ? 1 : 0;
+    }
+
+    static int column(sqlite3_vtab_cursor* cursor, sqlite3_context* context, int column) {
+        try {
+            static_cast<Cursor*>(cursor)->cursor->result(column, context);
+            return SQLITE_OK;
+        } catch (const std::exception& e) {
+            return fail(cursor->pVtab, e.what());
+        }
+    }
+
+    static int rowid(sqlite3_vtab_cursor* cursor, sqlite3_int64* result) {
+        *result = static_cast<Cursor*>(cursor)->cursor->rowid();
+        return SQLITE_OK;
+    }
+};
+
+void SQLite::registerVirtualTable(const std::string& name, std::unique_ptr<VirtualTableSource> source) {
+    ensure();
+    // the source is deleted by SQLite when the module is replaced, dropped or the connection closes, or if this fails
+    auto destroy = [](void* data) { delete static_cast<VirtualTableSource*>(data); };
+    if (sqlite3_create_module_v2(db, name.c_str(), &VirtualModule::module(), source.release(), destroy) != SQLITE_OK) {
+        throwSQLiteError(db, "failed to create virtual table " + name);
+    }
+}
+
+void SQLite::dropModule(const std::string& name) {
+    ensure();
+    if (sqlite3_create_module_v2(db, name.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throwSQLiteError(db, "failed to drop module " + name);
+    }
+}
+
+
+// CSV and JSON lines import/export
+
+namespace {
+
+// read-only view of a whole file, memory-mapped where available
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& fileName) {
+#if defined(_WIN32)
+        std::FILE* file = std::fopen(fileName.c_str(), "rb");
+        if (!file) {
+            throw SQLite::OtherError("failed to open " + fileName + ": " + std::strerror(errno));
+        }
+        char buffer[1 << 16];
+        size_t read;
+        while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            contents.append(buffer, read);
+        }
+        std::fclose(file);
+        data = contents.data();
+        size = contents.size();
+#else
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw SQLite::OtherError("failed to open " + fileName + ": " + std::strerror(errno));
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw SQLite::OtherError("failed to stat " + fileName + ": " + std::strerror(error));
+        }
+        size = static_cast<size_t>(info.st_size);
+        if (size > 0) {
+            void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                int error = errno;
+                ::close(fd);
+                throw SQLite::OtherError("failed to map " + fileName + ": " + std::strerror(error));
+            }
+            ::madvise(mapped, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(mapped);
+        }
+        ::close(fd); // the mapping stays valid
+#endif
+    }
+
+    ~MappedFile() {
+#if !defined(_WIN32)
+        if (size > 0) {
+            ::munmap(const_cast<char*>(data), size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* begin() const { return data; }
+    const char* end() const { return data + size; }
+
+private:
+    const char* data = "";
+    size_t size = 0;
+#if defined(_WIN32)
+    std::string contents;
+#endif
+};
+
+struct ImportValue {
+    enum Kind : uint8_t { Null, Integer, Float, Text, OwnedText };
+
+    Kind kind = Null;
+    int64_t integer = 0;
+    double real = 0;
+    const char* text = nullptr; // Text: into the file
+    size_t offset = 0; // OwnedText: into ImportChunk::buffer
+    size_t length = 0;
+};
+
+// parsed rows, columns values per row
+struct ImportChunk {
+    std::vector<ImportValue> values;
+    std::string buffer; // unescaped text
+    std::vector<size_t> lines; // line number of each row, for errors
+    size_t rows = 0;
+};
+
+// bounded hand-off of chunks from the parser thread
+class ChunkQueue {
+public:
+    static constexpr size_t Capacity = 4;
+
+    void push(ImportChunk&& chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return cancelled || chunks.size() < Capacity; });
+        if (!cancelled) {
+            chunks.push_back(std::move(chunk));
+            changed.notify_all();
+        }
+    }
+
+    bool isCancelled() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return cancelled;
+    }
+
+    void close(std::exception_ptr failure = nullptr) {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        error = failure;
+        changed.notify_all();
+    }
+
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled = true;
+        changed.notify_all();
+    }
+
+    // false once the parser is done, rethrows its error
+    bool pop(ImportChunk& chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return closed || !chunks.empty(); });
+        if (chunks.empty()) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return false;
+        }
+        chunk = std::move(chunks.front());
+        chunks.pop_front();
+        changed.notify_all();
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<ImportChunk> chunks;
+    bool closed = false;
+    bool cancelled = false;
+    std::exception_ptr error;
+};
+
+constexpr size_t ImportChunkRows = 4096;
+
+std::string importError(size_t line, const std::string& message) {
+    return "line " + std::to_string(line) + ": " + message;
+}
+
+std::string importError(size_t firstLine, size_t lastLine, const std::string& message) {
+    if (firstLine == lastLine) {
+        return importError(firstLine, message);
+    }
+    return "lines " + std::to_string(firstLine) + "-" + std::to_string(lastLine) + ": " + message;
+}
+
+// rethrow e with another message, keeping its type for callers that catch BusyError, InterruptedError, ...
+[[noreturn]] void rethrowImportError(const SQLite::Error& e, const std::string& message) {
+    if (auto syntax = dynamic_cast<const SQLite::SyntaxError*>(&e)) {
+        throw SQLite::SyntaxError(message, e.sqlite_errmsg, e.code, e.extended_code, syntax->sql, syntax->offset);
+    }
+    if (dynamic_cast<const SQLite::BusyError*>(&e)) {
+        throw SQLite::BusyError(message, e.sqlite_errmsg, e.code, e.extended_code);
+    }
+    if (dynamic_cast<const SQLite::InterruptedError*>(&e)) {
+        throw SQLite::InterruptedError(message, e.sqlite_errmsg, e.code, e.extended_code);
+    }
+    if (dynamic_cast<const SQLite::MisuseError*>(&e)) {
+        throw SQLite::MisuseError(message, e.sqlite_errmsg, e.code, e.extended_code);
+    }
+    throw SQLite::Error(message, e.sqlite_errmsg, e.code, e.extended_code);
+}
+
+class CsvParser {
+public:
+    CsvParser(const char* begin, const char* end, const SQLite::CsvOptions& options)
+        : position(begin), end(end), options(options) {}
+
+    bool atEnd() const { return position >= end; }
+    size_t line() const { return currentLine; }
+
+    // parse one record, appending its fields to chunk, false at the end of the input
+    bool record(ImportChunk& chunk, size_t& fields) {
+        fields = 0;
+        if (atEnd()) {
+            return false;
+        }
+        while (true) {
+            chunk.values.push_back(field(chunk));
+            ++fields;
+            if (atEnd()) {
+                return true;
+            }
+            char c = *position++;
+            if (c == options.delimiter) {
+                continue;
+            }
+            if (c == '\r' && position < end && *position == '\n') {
+                ++position;
+            }
+            ++currentLine;
+            return true; // '\n' or '\r'
+        }
+    }
+
+private:
+    const char* position;
+    const char* end;
+    const SQLite::CsvOptions& options;
+    size_t currentLine = 1;
+
+    ImportValue field(ImportChunk& chunk) {
+        ImportValue value;
+        value.kind = ImportValue::Text;
+        if (position < end && *position == options.quote) {
+            ++position;
+            const char* start = position;
+            bool escaped = false;
+            while (true) {
+                if (position >= end) {
+                    throw SQLite::OtherError(importError(currentLine, "unterminated quoted field"));
+                }
+                if (*position == options.quote) {
+                    if (position + 1 < end && position[1] == options.quote) {
+                        escaped = true;
+                        position += 2;
+                        continue;
+                    }
+                    break;
+                }
+                if (*position == '\n') {
+                    ++currentLine;
+                }
+                ++position;
+            }
+            if (escaped) {
+                // collapse doubled quotes into the chunk buffer
+                value.kind = ImportValue::OwnedText;
+                value.offset = chunk.buffer.size();
+                for (const char* p = start; p < position; ++p) {
+                    chunk.buffer += *p;
+                    if (*p == options.quote) {
+                        ++p;
+                    }
+                }
+                value.length = chunk.buffer.size() - value.offset;
+            } else {
+                value.text = start;
+                value.length = position - start;
+            }
+            ++position; // closing quote
+            if (position < end && *position != options.delimiter && *position != '\n' && *position != '\r') {
+                throw SQLite::OtherError(importError(currentLine, "unexpected character after quoted field"));
+            }
+            return value;
+        }
+        const char* start = position;
+        while (position < end && *position != options.delimiter && *position != '\n' && *position != '\r') {
+            ++position;
+        }
+        value.text = start;
+        value.length = position - start;
+        if (value.length == 0 && options.emptyIsNull) {
+            value.kind = ImportValue::Null;
+        }
+        return value;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const char* begin, const char* end) : position(begin), end(end) {}
+
+    size_t line() const { return currentLine; }
+
+    // next non-empty line holding an object, false at the end; key(name) returns the column or -1 if unknown
+    template<typename Key>
+    bool object(ImportChunk& chunk, size_t columns, Key key) {
+        while (position < end && (*position == '\n' || *position == '\r' || *position == ' ' || *position == '\t')) {
+            if (*position == '\n') {
+                ++currentLine;
+            }
+            ++position;
+        }
+        if (position >= end) {
+            return false;
+        }
+        size_t first = chunk.values.size();
+        chunk.values.resize(first + columns);
+        expect('{');
+        skipSpace();
+        if (peek() == '}') {
+            ++position;
+        } else {
+            while (true) {
+                skipSpace();
+                ImportValue name = string(chunk);
+                std::string_view nameView = text(chunk, name);
+                skipSpace();
+                expect(':');
+                skipSpace();
+                ImportValue value = this->value(chunk);
+                long column = key(nameView);
+                if (column < 0) {
+                    throw SQLite::OtherError(importError(currentLine, "unknown column " + std::string(nameView)));
+                }
+                chunk.values[first + column] = value;
+                skipSpace();
+                if (peek() == ',') {
+                    ++position;
+                    continue;
+                }
+                expect('}');
+                break;
+            }
+        }
+        skipSpace();
+        if (position < end && *position != '\n' && *position != '\r') {
+            throw SQLite::OtherError(importError(currentLine, "expected end of line after object"));
+        }
+        return true;
+    }
+
+    // keys of the next object, in order, for the column list
+    std::vector<std::string> keys() {
+        ImportChunk scratch;
+        std::vector<std::string> names;
+        const char* start = position;
+        size_t startLine = currentLine;
+        object(scratch, 0, [&](std::string_view name) {
+            names.emplace_back(name);
+            scratch.values.resize(names.size());
+            return static_cast<long>(names.size() - 1);
+        });
+        position = start;
+        currentLine = startLine;
+        return names;
+    }
+
+    static std::string_view text(const ImportChunk& chunk, const ImportValue& value) {
+        if (value.kind == ImportValue::OwnedText) {
+            return std::string_view(chunk.buffer.data() + value.offset, value.length);
+        }
+        return std::string_view(value.text, value.length);
+    }
+
+private:
+    const char* position;
+    const char* end;
+    size_t currentLine = 1;
+
+    char peek() const { return position < end ? *position : '\0'; }
+
+    void skipSpace() {
+        while (position < end && (*position == ' ' || *position == '\t')) {
+            ++position;
+        }
+    }
+
+    void expect(char c) {
+        if (peek() != c) {
+            throw SQLite::OtherError(importError(currentLine, std::string("expected '") + c + "'"));
+        }
+        ++position;
+    }
+
+    [[noreturn]] void fail(const char* message) const {
+        throw SQLite::OtherError(importError(currentLine, message));
+    }
+
+    ImportValue value(ImportChunk& chunk) {
+        ImportValue value;
+        char c = peek();
+        if (c == '"') {
+            return string(chunk);
+        }
+        if (c == '{' || c == '[') {
+            value.kind = ImportValue::Text; // kept as JSON text
+            value.text = position;
+            skipNested();
+            value.length = position - value.text;
+            return value;
+        }
+        if (literal("null")) {
+            return value;
+        }
+        if (literal("true")) {
+            value.kind = ImportValue::Integer;
+            value.integer = 1;
+            return value;
+        }
+        if (literal("false")) {
+            value.kind = ImportValue::Integer;
+            value.integer = 0;
+            return value;
+        }
+        const char* start = position;
+        bool isFloat = false;
+        while (position < end && (std::isdigit(static_cast<unsigned char>(*position)) || *position == '-' || *position == '+'
+                || *position == '.' || *position == 'e' || *position == 'E')) {
+            isFloat = isFloat || *position == '.' || *position == 'e' || *position == 'E';
+            ++position;
+        }
+        if (start == position) {
+            fail("invalid value");
+        }
+        if (!isFloat) {
+            auto result = std::from_chars(start, position, value.integer);
+            if (result.ec == std::errc() && result.ptr == position) {
+                value.kind = ImportValue::Integer;
+                return value;
+            }
+        }
+        auto result = std::from_chars(start, position, value.real);
+        if (result.ec != std::errc() || result.ptr != position) {
+            fail("invalid number");
+        }
+        value.kind = ImportValue::Float;
+        return value;
+    }
+
+    bool literal(std::string_view word) {
+        if (static_cast<size_t>(end - position) >= word.size() && std::string_view(position, word.size()) == word) {
+            position += word.size();
+            return true;
+        }
+        return false;
+    }
+
+    // skip a balanced object or array, strings may contain brackets
+    void skipNested() {
+        int depth = 0;
+        do {
+            if (position >= end || *position == '\n') {
+                fail("unterminated object or array");
+            }
+            char c = *position;
+            if (c == '"') {
+                ImportChunk scratch;
+                string(scratch);
+                continue;
+            }
+            if (c == '{' || c == '[') ++depth;
+            if (c == '}' || c == ']') --depth;
+            ++position;
+        } while (depth > 0);
+    }
+
+    static void appendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    uint32_t hex4() {
+        if (end - position < 4) {
+            fail("invalid escape");
+        }
+        uint32_t code = 0;
+        auto result = std::from_chars(position, position + 4, code, 16);
+        if (result.ptr != position + 4) {
+            fail("invalid escape");
+        }
+        position += 4;
+        return code;
+    }
+
+    ImportValue string(ImportChunk& chunk) {
+        expect('"');
+        ImportValue value;
+        value.kind = ImportValue::Text;
+        const char* start = position;
+        while (position < end && *position != '"' && *position != '\\') {
+            ++position;
+        }
+        if (peek() == '"') {
+            // no escapes, view into the file
+            value.text = start;
+            value.length = position - start;
+            ++position;
+            return value;
+        }
+        value.kind = ImportValue::OwnedText;
+        size_t offset = chunk.buffer.size();
+        chunk.buffer.append(start, position);
+        while (true) {
+            if (position >= end || *position == '\n') {
+                fail("unterminated string");
+            }
+            char c = *position++;
+            if (c == '"') {
+                break;
+            }
+            if (c != '\\') {
+                chunk.buffer += c;
+                continue;
+            }
+            if (position >= end) {
+                fail("invalid escape");
+            }
+            switch (*position++) {
+                case '"': chunk.buffer += '"'; break;
+                case '\\': chunk.buffer += '\\'; break;
+                case '/': chunk.buffer += '/'; break;
+                case 'b': chunk.buffer += '\b'; break;
+                case 'f': chunk.buffer += '\f'; break;
+                case 'n': chunk.buffer += '\n'; break;
+                case 'r': chunk.buffer += '\r'; break;
+                case 't': chunk.buffer += '\t'; break;
+                case 'u': {
+                    uint32_t code = hex4();
+                    if (code >= 0xD800 && code < 0xDC00 && literal("\\u")) {
+                        uint32_t low = hex4();
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(chunk.buffer, code);
+                    break;
+                }
+                default:
+                    fail("invalid escape");
+            }
+        }
+        value.offset = offset;
+        value.length = chunk.buffer.size() - offset;
+        return value;
+    }
+};
+
+void bindImportValue(SQLite::Statement& statement, int index, const ImportChunk& chunk, const ImportValue& value) {
+    switch (value.kind) {
+        case ImportValue::Null:
+            statement.bind(index, nullptr);
+            break;
+        case ImportValue::Integer:
+            statement.bind(index, value.integer);
+            break;
+        case ImportValue::Float:
+            statement.bind(index, value.real);
+            break;
+        case ImportValue::Text:
+            // points into the mapped file, which outlives the inserter and its pending multi-row bindings
+            statement.bind(index, JsonParser::text(chunk, value), SQLite::borrowed);
+            break;
+        case ImportValue::OwnedText:
+            statement.bind(index, JsonParser::text(chunk, value)); // copied by SQLite, chunks are recycled
+            break;
+    }
+}
+
+// parse on a second thread, insert on this one
+template<typename Parse>
+SQLite::TransferStats runImport(SQLite::BulkInserter& inserter, size_t columns, size_t fileSize, Parse parse) {
+    auto start = std::chrono::steady_clock::now();
+    ChunkQueue queue;
+    std::thread parser([&] {
+        try {
+            parse(queue);
+            queue.close();
+        } catch (...) {
+            queue.close(std::current_exception());
+        }
+    });
+
+    try {
+        // with multi-row statements a constraint error is only seen when the batch is stepped, so errors
+        // name the lines of the rows not yet inserted
+        size_t firstPendingLine = 0;
+        size_t lastLine = 0;
+        ImportChunk chunk;
+        while (queue.pop(chunk)) {
+            for (size_t row = 0; row < chunk.rows; ++row) {
+                const ImportValue* values = chunk.values.data() + row * columns;
+                lastLine = chunk.lines[row];
+                if (inserter.pending() == 0) {
+                    firstPendingLine = lastLine;
+                }
+                try {
+                    inserter.insertRow(columns, [&](SQLite::Statement& statement, int index, size_t column) {
+                        bindImportValue(statement, index, chunk, values[column]);
+                    });
+                } catch (const SQLite::Error& e) {
+                    rethrowImportError(e, importError(firstPendingLine, lastLine, e.message));
+                }
+            }
+        }
+        try {
+            inserter.finish();
+        } catch (const SQLite::Error& e) {
+            if (lastLine == 0) {
+                throw; // no rows were read, the error is not about one of them
+            }
+            rethrowImportError(e, importError(firstPendingLine, lastLine, e.message));
+        }
+    } catch (...) {
+        queue.cancel();
+        parser.join();
+        throw;
+    }
+    parser.join();
+
+    SQLite::TransferStats stats;
+    stats.rows = inserter.stats().rows;
+    stats.bytes = fileSize;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+// buffered output file, throws on write errors
+class FileWriter {
+public:
+    explicit FileWriter(const std::string& fileName) : fileName(fileName), file(std::fopen(fileName.c_str(), "wb")) {
+        if (!file) {
+            throw SQLite::OtherError("failed to create " + fileName + ": " + std::strerror(errno));
+        }
+        buffer.reserve(Capacity);
+    }
+
+    ~FileWriter() {
+        if (file) {
+            std::fclose(file);
+        }
+    }
+
+    void write(std::string_view text) {
+        if (buffer.size() + text.size() > Capacity) {
+            flush();
+            if (text.size() > Capacity) {
+                put(text.data(), text.size());
+                return;
+            }
+        }
+        buffer.insert(buffer.end(), text.begin(), text.end());
+    }
+
+    void write(char c) {
+        if (buffer.size() == Capacity) {
+            flush();
+        }
+        buffer.push_back(c);
+    }
+
+    void write(int64_t value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        write(std::string_view(digits, result.ptr - digits));
+    }
+
+    // shortest text that reads back as the same double, integral values keep a ".0" so they stay REAL
+    void write(double value) {
+        char digits[40];
+        auto result = std::to_chars(digits, digits + sizeof(digits) - 2, value);
+        std::string_view text(digits, result.ptr - digits);
+        if (text.find_first_of(".en") == std::string_view::npos) {
+            *result.ptr++ = '.';
+            *result.ptr++ = '0';
+        }
+        write(std::string_view(digits, result.ptr - digits));
+    }
+
+    void writeHex(const SQLite::Blob& blob) {
+        static const char hex[] = "0123456789abcdef";
+        auto bytes = static_cast<const unsigned char*>(blob.data);
+        for (int i = 0; i < blob.size; ++i) {
+            write(hex[bytes[i] >> 4]);
+            write(hex[bytes[i] & 0xF]);
+        }
+    }
+
+    void close() {
+        flush();
+        std::FILE* closing = file;
+        file = nullptr;
+        if (std::fclose(closing) != 0) {
+            throw SQLite::OtherError("failed to write " + fileName + ": " + std::strerror(errno));
+        }
+    }
+
+    uint64_t bytes() const { return written + buffer.size(); }
+
+private:
+    static constexpr size_t Capacity = 1 << 20;
+
+    std::string fileName;
+    std::FILE* file;
+    std::vector<char> buffer;
+    uint64_t written = 0;
+
+    void flush() {
+        put(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    void put(const char* data, size_t size) {
+        if (size > 0 && std::fwrite(data, 1, size, file) != size) {
+            throw SQLite::OtherError("failed to write " + fileName + ": " + std::strerror(errno));
+        }
+        written += size;
+    }
+};
+
+void writeCsvText(FileWriter& out, std::string_view text, const SQLite::CsvOptions& options) {
+    bool quoted = false;
+    for (char c : text) {
+        if (c == options.delimiter || c == options.quote || c == '\n' || c == '\r') {
+            quoted = true;
+            break;
+        }
+    }
+    if (!quoted) {
+        out.write(text);
+        return;
+    }
+    out.write(options.quote);
+    size_t start = 0;
+    size_t quote;
+    while ((quote = text.find(options.quote, start)) != std::string_view::npos) {
+        out.write(text.substr(start, quote + 1 - start));
+        out.write(options.quote); // doubled
+        start = quote + 1;
+    }
+    out.write(text.substr(start));
+    out.write(options.quote);
+}
+
+void writeJsonString(FileWriter& out, std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    out.write('"');
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c != '"' && c != '\\' && c >= 0x20) {
+            continue;
+        }
+        out.write(text.substr(start, i - start));
+        out.write('\\');
+        switch (c) {
+            case '"': out.write('"'); break;
+            case '\\': out.write('\\'); break;
+            case '\n': out.write('n'); break;
+            case '\r': out.write('r'); break;
+            case '\t': out.write('t'); break;
+            default:
+                out.write(std::string_view("u00"));
+                out.write(hex[c >> 4]);
+                out.write(hex[c & 0xF]);
+        }
+        start = i + 1;
+    }
+    out.write(text.substr(start));
+    out.write('"');
+}
+
+} // namespace
+
+SQLite::TransferStats SQLite::importCsv(const std::string& fileName, const std::string& table) {
+    return importCsv(fileName, table, CsvOptions(), BulkInsertOptions());
+}
+
+SQLite::TransferStats SQLite::importCsv(const std::string& fileName, const std::string& table, const CsvOptions& options) {
+    return importCsv(fileName, table, options, BulkInsertOptions());
+}
+
+SQLite::TransferStats SQLite::importCsv(const std::string& fileName, const std::string& table, const CsvOptions& options,
+        const BulkInsertOptions& insertOptions) {
+    ensure();
+    MappedFile file(fileName);
+    CsvParser parser(file.begin(), file.end(), options);
+
+    std::vector<std::string> columns;
+    if (options.header) {
+        ImportChunk header;
+        size_t fields = 0;
+        if (!parser.record(header, fields)) {
+            return TransferStats(); // empty file
+        }
+        for (const auto& value : header.values) {
+            columns.push_back(quoteIdentifier(std::string(JsonParser::text(header, value))));
+        }
+    } else {
+        Statement info(db, "SELECT name FROM pragma_table_info(?)");
+        info.bind(1, table);
+        while (info.step()) {
+            columns.push_back(quoteIdentifier(info.getString(0)));
+        }
+        if (columns.empty()) {
+            throw SQLite::OtherError("no such table: " + table);
+        }
     }
+
+    BulkInserter inserter(*this, quoteIdentifier(table), columns, insertOptions);
+    size_t count = columns.size();
+    return runImport(inserter, count, file.end() - file.begin(), [&](ChunkQueue& queue) {
+        while (!parser.atEnd() && !queue.isCancelled()) {
+            ImportChunk chunk;
+            chunk.values.reserve(ImportChunkRows * count);
+            while (chunk.rows < ImportChunkRows) {
+                size_t line = parser.line();
+                size_t fields = 0;
+                if (!parser.record(chunk, fields)) {
+                    break;
+                }
+                if (fields == 1 && count > 1 && chunk.values.back().length == 0 && chunk.values.back().kind != ImportValue::Null
+                        && parser.atEnd()) {
+                    chunk.values.pop_back(); // trailing empty line
+                    break;
+                }
+                if (fields != count) {
+                    throw SQLite::OtherError(importError(line, "expected " + std::to_string(count) + " fields, got "
+                            + std::to_string(fields)));
+                }
+                chunk.lines.push_back(line);
+                ++chunk.rows;
+            }
+            if (chunk.rows > 0) {
+                queue.push(std::move(chunk));
+            }
+        }
+    });
 }
 
-void SQLite::exec(const std::string& sql) {
+SQLite::TransferStats SQLite::importJsonLines(const std::string& fileName, const std::string& table) {
+    return importJsonLines(fileName, table, BulkInsertOptions());
+}
+
+SQLite::TransferStats SQLite::importJsonLines(const std::string& fileName, const std::string& table,
+        const BulkInsertOptions& insertOptions) {
     ensure();
-    int result = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr);
-    if (result != SQLITE_OK) {
-        throwSQLiteError(db, "failed to execute SQL query", sql);
+    MappedFile file(fileName);
+    JsonParser parser(file.begin(), file.end());
+
+    std::vector<std::string> names = parser.keys();
+    if (names.empty()) {
+        return TransferStats(); // empty file or no keys
+    }
+    std::unordered_map<std::string_view, long> indices;
+    std::vector<std::string> columns;
+    for (size_t i = 0; i < names.size(); ++i) {
+        indices.emplace(names[i], static_cast<long>(i));
+        columns.push_back(quoteIdentifier(names[i]));
+    }
+
+    BulkInserter inserter(*this, quoteIdentifier(table), columns, insertOptions);
+    size_t count = columns.size();
+    auto key = [&indices](std::string_view name) {
+        auto it = indices.find(name);
+        return it != indices.end() ? it->second : -1L;
+    };
+    return runImport(inserter, count, file.end() - file.begin(), [&](ChunkQueue& queue) {
+        bool more = true;
+        while (more && !queue.isCancelled()) {
+            ImportChunk chunk;
+            chunk.values.reserve(ImportChunkRows * count);
+            while (chunk.rows < ImportChunkRows) {
+                size_t line = parser.line();
+                if (!parser.object(chunk, count, key)) {
+                    more = false;
+                    break;
+                }
+                chunk.lines.push_back(line);
+                ++chunk.rows;
+            }
+            if (chunk.rows > 0) {
+                queue.push(std::move(chunk));
+            }
+        }
+    });
+}
+
+SQLite::TransferStats SQLite::exportCsv(Statement& statement, const std::string& fileName) {
+    return exportCsv(statement, fileName, CsvOptions());
+}
+
+SQLite::TransferStats SQLite::exportCsv(Statement& statement, const std::string& fileName, const CsvOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+    FileWriter out(fileName);
+    int columns = statement.columnCount();
+    if (options.header) {
+        for (int i = 0; i < columns; ++i) {
+            if (i > 0) {
+                out.write(options.delimiter);
+            }
+            writeCsvText(out, sqlite3_column_name(statement.handle(), i), options);
+        }
+        out.write('\n');
+    }
+
+    TransferStats stats;
+    while (statement.step()) {
+        for (int i = 0; i < columns; ++i) {
+            if (i > 0) {
+                out.write(options.delimiter);
+            }
+            switch (sqlite3_column_type(statement.handle(), i)) {
+                case SQLITE_INTEGER:
+                    out.write(static_cast<int64_t>(sqlite3_column_int64(statement.handle(), i)));
+                    break;
+                case SQLITE_FLOAT:
+                    out.write(sqlite3_column_double(statement.handle(), i));
+                    break;
+                case SQLITE_TEXT:
+                    writeCsvText(out, statement.getStringView(i), options);
+                    break;
+                case SQLITE_BLOB:
+                    out.writeHex(statement.getBlob(i));
+                    break;
+                default:
+                    break; // NULL is an empty field
+            }
+        }
+        out.write('\n');
+        ++stats.rows;
+    }
+    out.close();
+    stats.bytes = out.bytes();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+SQLite::TransferStats SQLite::exportJsonLines(Statement& statement, const std::string& fileName) {
+    auto start = std::chrono::steady_clock::now();
+    FileWriter out(fileName);
+    int columns = statement.columnCount();
+
+    // keys are the same for every row, format them once
+    std::vector<std::string> keys;
+    for (int i = 0; i < columns; ++i) {
+        std::string name = sqlite3_column_name(statement.handle(), i);
+        std::string key = i == 0 ? "{" : ",";
+        key += '"';
+        for (char c : name) {
+            if (c == '"' || c == '\\') {
+                key += '\\';
+            }
+            key += c;
+        }
+        key += "\":";
+        keys.push_back(std::move(key));
+    }
+
+    TransferStats stats;
+    while (statement.step()) {
+        for (int i = 0; i < columns; ++i) {
+            out.write(keys[i]);
+            switch (sqlite3_column_type(statement.handle(), i)) {
+                case SQLITE_INTEGER:
+                    out.write(static_cast<int64_t>(sqlite3_column_int64(statement.handle(), i)));
+                    break;
+                case SQLITE_FLOAT: {
+                    double value = sqlite3_column_double(statement.handle(), i);
+                    if (std::isfinite(value)) {
+                        out.write(value);
+                    } else {
+                        out.write(std::string_view("null")); // not representable in JSON
+                    }
+                    break;
+                }
+                case SQLITE_TEXT:
+                    writeJsonString(out, statement.getStringView(i));
+                    break;
+                case SQLITE_BLOB:
+                    out.write('"');
+                    out.writeHex(statement.getBlob(i));
+                    out.write('"');
+                    break;
+                default:
+                    out.write(std::string_view("null"));
+            }
+        }
+        out.write(std::string_view(columns > 0 ? "}\n" : "{}\n"));
+        ++stats.rows;
+    }
+    out.close();
+    stats.bytes = out.bytes();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+
+// Arrow C data interface export
+
+namespace {
+
+const char* arrowFormat(SQLite::DataType type) {
+    switch (type) {
+        case SQLite::DataType::Integer: return "l"; // int64
+        case SQLite::DataType::Float: return "g"; // float64
+        case SQLite::DataType::Text: return "u"; // utf8, int32 offsets
+        case SQLite::DataType::Blob: return "z"; // binary, int32 offsets
+        default: return "n"; // null, no rows to infer a type from
+    }
+}
+
+// non-null placeholder for empty buffers
+const int64_t arrowEmptyBuffer[1] = {0};
+
+const void* arrowBuffer(const void* data) {
+    return data ? data : arrowEmptyBuffer;
+}
+
+struct ArrowSchemaData {
+    std::vector<std::string> names;
+    std::vector<ArrowSchema> children;
+    std::vector<ArrowSchema*> pointers;
+};
+
+void releaseArrowChildSchema(ArrowSchema* schema) {
+    schema->release = nullptr; // owned by the parent
+}
+
+void releaseArrowSchema(ArrowSchema* schema) {
+    auto data = static_cast<ArrowSchemaData*>(schema->private_data);
+    for (auto& child : data->children) {
+        if (child.release) {
+            child.release(&child);
+        }
+    }
+    delete data;
+    schema->release = nullptr;
+}
+
+void exportArrowSchema(const SQLite::ColumnBatch& batch, ArrowSchema* out) {
+    auto data = new ArrowSchemaData();
+    size_t count = batch.columns.size();
+    data->names.reserve(count);
+    data->children.resize(count);
+    data->pointers.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        data->names.push_back(batch.columns[i].name);
+        ArrowSchema& child = data->children[i];
+        child = ArrowSchema{arrowFormat(batch.columns[i].type), data->names.back().c_str(), nullptr, ARROW_FLAG_NULLABLE,
+                0, nullptr, nullptr, releaseArrowChildSchema, nullptr};
+        data->pointers[i] = &child;
+    }
+    *out = ArrowSchema{"+s", "", nullptr, 0, static_cast<int64_t>(count), data->pointers.data(), nullptr, releaseArrowSchema, data};
+}
+
+struct ArrowArrayData {
+    SQLite::ColumnBatch batch; // owns the buffers
+    std::vector<std::array<const void*, 3>> buffers;
+    std::vector<ArrowArray> children;
+    std::vector<ArrowArray*> pointers;
+    const void* structBuffers[1] = {nullptr};
+};
+
+void releaseArrowChildArray(ArrowArray* array) {
+    array->release = nullptr; // owned by the parent
+}
+
+void releaseArrowArray(ArrowArray* array) {
+    auto data = static_cast<ArrowArrayData*>(array->private_data);
+    for (auto& child : data->children) {
+        if (child.release) {
+            child.release(&child);
+        }
+    }
+    delete data;
+    array->release = nullptr;
+}
+
+void exportArrowArray(SQLite::ColumnBatch&& batch, ArrowArray* out) {
+    auto data = new ArrowArrayData();
+    data->batch = std::move(batch);
+    size_t count = data->batch.columns.size();
+    int64_t rows = static_cast<int64_t>(data->batch.rows);
+    data->buffers.resize(count);
+    data->children.resize(count);
+    data->pointers.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto& column = data->batch.columns[i];
+        auto& buffers = data->buffers[i];
+        buffers[0] = column.nullCount > 0 ? column.validity.data() : nullptr;
+        int64_t bufferCount = 2;
+        switch (column.type) {
+            case SQLite::DataType::Integer:
+                buffers[1] = arrowBuffer(column.integers.data());
+                break;
+            case SQLite::DataType::Float:
+                buffers[1] = arrowBuffer(column.floats.data());
+                break;
+            case SQLite::DataType::Text:
+            case SQLite::DataType::Blob:
+                buffers[1] = arrowBuffer(column.offsets.data());
+                buffers[2] = arrowBuffer(column.data.data());
+                bufferCount = 3;
+                break;
+            default:
+                bufferCount = 0; // null type has no buffers
+                break;
+        }
+        int64_t nullCount = column.type == SQLite::DataType::Null ? rows : static_cast<int64_t>(column.nullCount);
+        data->children[i] = ArrowArray{rows, nullCount, 0, bufferCount, 0, buffers.data(), nullptr, nullptr,
+                releaseArrowChildArray, nullptr};
+        data->pointers[i] = &data->children[i];
+    }
+    *out = ArrowArray{rows, 0, 0, 1, static_cast<int64_t>(count), data->structBuffers, data->pointers.data(), nullptr,
+            releaseArrowArray, data};
+}
+
+}
+
+struct ArrowStreamData {
+    SQLite::Statement* statement;
+    size_t batchRows;
+    SQLite::ColumnBatch types; // column names and types, no rows
+    std::optional<SQLite::ColumnBatch> first; // fetched on export to fix the types
+    std::string error;
+
+    SQLite::ColumnBatch emptyBatch() const {
+        SQLite::ColumnBatch batch;
+        batch.columns.resize(types.columns.size());
+        for (size_t i = 0; i < types.columns.size(); ++i) {
+            batch.columns[i].name = types.columns[i].name;
+            batch.columns[i].type = types.columns[i].type;
+        }
+        return batch;
+    }
+
+    static ArrowStreamData& of(ArrowArrayStream* stream) { return *static_cast<ArrowStreamData*>(stream->private_data); }
+
+    static int getSchema(ArrowArrayStream* stream, ArrowSchema* out) {
+        auto& data = of(stream);
+        try {
+            exportArrowSchema(data.types, out);
+            return 0;
+        } catch (const std::exception& e) {
+            data.error = e.what();
+            return ENOMEM;
+        }
+    }
+
+    static int getNext(ArrowArrayStream* stream, ArrowArray* out) {
+        auto& data = of(stream);
+        try {
+            SQLite::ColumnBatch batch;
+            if (data.first) {
+                batch = std::move(*data.first);
+                data.first.reset();
+            } else {
+                batch = data.emptyBatch();
+                data.statement->fetchBatch(batch, data.batchRows);
+            }
+            if (batch.rows == 0) {
+                out->release = nullptr; // end of stream
+                return 0;
+            }
+            exportArrowArray(std::move(batch), out);
+            return 0;
+        } catch (const std::exception& e) {
+            data.error = e.what();
+            return EIO;
+        }
+    }
+
+    static const char* getLastError(ArrowArrayStream* stream) {
+        auto& data = of(stream);
+        return data.error.empty() ? nullptr : data.error.c_str();
+    }
+
+    static void release(ArrowArrayStream* stream) {
+        delete static_cast<ArrowStreamData*>(stream->private_data);
+        stream->release = nullptr;
+    }
+};
+
+void SQLite::Statement::exportArrow(ArrowArrayStream* out, size_t batchRows) {
+    ensure();
+    auto data = std::make_unique<ArrowStreamData>();
+    data->statement = this;
+    data->batchRows = batchRows > 0 ? batchRows : 1;
+
+    ColumnBatch first;
+    fetchBatch(first, data->batchRows);
+    data->types.columns.resize(first.columns.size());
+    for (size_t i = 0; i < first.columns.size(); ++i) {
+        auto& column = data->types.columns[i];
+        const char* name = sqlite3_column_name(stmt, static_cast<int>(i));
+        column.name = name ? name : "";
+        column.type = first.columns[i].type;
+        if (column.type == DataType::Null) {
+            // no rows, fall back to the declared type
+            column.type = declaredDataType(sqlite3_column_decltype(stmt, static_cast<int>(i)));
+        }
+    }
+    data->first = std::move(first);
+
+    *out = ArrowArrayStream{ArrowStreamData::getSchema, ArrowStreamData::getNext, ArrowStreamData::getLastError,
+            ArrowStreamData::release, data.release()};
+}
+
+
+SQLite::ShardedExecutor::ShardedExecutor(const std::vector<std::string>& dbNames, OpenFlags flags, size_t threads) {
+    if (!SQLite::isThreadsafe()) {
+        throw SQLite::OtherError("sharded executor requires SQLite compiled with thread-safety");
+    }
+    if (!(flags & OpenFlags::FullMutex)) {
+        flags = flags | OpenFlags::NoMutex; // each connection is used by one task at a time
+    }
+    shards.reserve(dbNames.size());
+    for (const auto& dbName : dbNames) {
+        shards.push_back(Shard{std::make_unique<SQLite>(dbName, flags), std::make_unique<std::mutex>()});
+    }
+
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0 || threads > shards.size()) {
+            threads = shards.size();
+        }
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    this->threads.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        this->threads.emplace_back([this] { work(); });
+    }
+}
+
+SQLite::ShardedExecutor::~ShardedExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void SQLite::ShardedExecutor::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+void SQLite::ShardedExecutor::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return; // stopping and drained
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
     }
 }
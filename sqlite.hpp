@@ -4,7 +4,84 @@
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <memory_resource>
 #include <type_traits>
+#include <list>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <variant>
+#include <tuple>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <iterator>
+#include <utility>
+#include <array>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <deque>
+#include <queue>
+#include <algorithm>
+#include <cstring>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+
+// Arrow C data interface (https://arrow.apache.org/docs/format/CDataInterface.html), ABI-stable definitions
+// shared with any other producer or consumer through the guard macros
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+    int (*get_schema)(struct ArrowArrayStream*, struct ArrowSchema* out);
+    int (*get_next)(struct ArrowArrayStream*, struct ArrowArray* out);
+    const char* (*get_last_error)(struct ArrowArrayStream*);
+    void (*release)(struct ArrowArrayStream*);
+    void* private_data;
+};
+
+#endif // ARROW_C_STREAM_INTERFACE
 
 
 class SQLite {
@@ -39,6 +116,12 @@ public:
         using Error::Error;
     };
 
+    // statement stopped by interrupt(), a cancelled CancellationToken, an expired Deadline or a progress handler
+    class InterruptedError : public Error {
+    public:
+        using Error::Error;
+    };
+
     class MisuseError : public Error {
     public:
         using Error::Error;
@@ -51,6 +134,16 @@ public:
         OtherError(const std::string& message) : std::runtime_error(message) {}
     };
 
+    // query plan rejected by a plan requirement or the connection's PlanGuard
+    class PlanError : public OtherError {
+    public:
+        PlanError(const std::string& message, const std::string& sql, const std::string& plan)
+            : OtherError(message + ": " + sql + "\n" + plan), sql(sql), plan(plan) {}
+
+        const std::string sql;
+        const std::string plan; // QueryPlan::toString()
+    };
+
     enum class OpenFlags {
         None = 0,
         ReadOnly = 1 << 0,
@@ -79,25 +172,366 @@ public:
         int size;
     };
 
+    // batch of rows in columnar, Arrow-compatible buffers, see Statement::fetchBatch()
+    struct ColumnBatch {
+        struct Column {
+            std::string name;
+            DataType type = DataType::Null; // Integer, Float, Text or Blob, fixed on the first batch
+            std::vector<uint8_t> validity; // bit i (LSB first) set if row i is not NULL
+            size_t nullCount = 0;
+            std::vector<int64_t> integers; // Integer
+            std::vector<double> floats; // Float
+            std::vector<int32_t> offsets; // Text and Blob, rows + 1 entries into data
+            std::vector<char> data; // Text (UTF-8, not terminated) and Blob
+
+            bool isNull(size_t row) const { return !(validity[row / 8] & (1u << (row % 8))); }
+        };
+
+        size_t rows = 0;
+        std::vector<Column> columns;
+    };
+
+    // zero-filled blob of the given size, to be filled in place with BlobStream
+    struct ZeroBlob {
+        int64_t size;
+    };
+
+    // tag to bind text or blob without copying (SQLITE_STATIC), the buffer must stay valid
+    // until the parameter is rebound, clearBindings() is called or the statement is finalized
+    struct Borrowed {};
+    static constexpr Borrowed borrowed{};
+
+    enum class JournalMode {
+        Delete,
+        Truncate,
+        Persist,
+        Memory,
+        WAL,
+        Off
+    };
+
+    enum class Synchronous {
+        Off,
+        Normal,
+        Full,
+        Extra
+    };
+
+    enum class TempStore {
+        Default,
+        File,
+        Memory
+    };
+
+    // per-connection tuning applied by open(), unset values are left at SQLite's defaults
+    struct OpenOptions {
+        struct Lookaside {
+            int slotSize;
+            int slotCount;
+        };
+
+        std::optional<int> pageSize; // applied first, only effective before the database is created (or on VACUUM)
+        std::optional<JournalMode> journalMode;
+        std::optional<Synchronous> synchronous;
+        std::optional<int64_t> mmapSize; // bytes, capped by SQLITE_MAX_MMAP_SIZE
+        std::optional<int> cacheSize; // pages if positive, KiB if negative
+        std::optional<TempStore> tempStore;
+        std::optional<int> walAutocheckpoint; // pages, 0 disables
+        std::optional<Lookaside> lookaside; // SQLITE_DBCONFIG_LOOKASIDE
+    };
+
     static bool isThreadsafe(); // check if SQLite is compiled with thread-safety
     static std::unique_ptr<Error> configureSerialized(); // configure SQLite for serialized threading mode
 
+    // process-wide memory arenas (sqlite3_config), only before SQLite is initialized (first open) or after sqlite3_shutdown()
+    static std::unique_ptr<Error> configurePageCache(void* buffer, int slotSize, int slotCount); // SQLITE_CONFIG_PAGECACHE
+    static std::unique_ptr<Error> configureLookaside(int slotSize, int slotCount); // SQLITE_CONFIG_LOOKASIDE default
+
+    // route SQLite's own allocations through resource (SQLITE_CONFIG_MALLOC), which must outlive all use of SQLite;
+    // same restrictions as the other sqlite3_config calls, nullptr restores the allocator SQLite was built with
+    static std::unique_ptr<Error> configureMalloc(std::pmr::memory_resource* resource);
+
+    // process-wide resource keeping per-thread free lists of small blocks, to avoid contention on the global heap
+    static std::pmr::memory_resource* threadCachingResource();
+
+    // resource for the wrapper's internal buffers (column-name maps), nullptr for std::pmr::get_default_resource()
+    static void setMemoryResource(std::pmr::memory_resource* resource);
+    static std::pmr::memory_resource* memoryResource();
+
+    // process-wide memory use from sqlite3_status64(), current values and high-water marks
+    struct MemoryStats {
+        int64_t used = 0; // bytes allocated by SQLite
+        int64_t usedHighwater = 0;
+        int64_t allocations = 0; // outstanding allocations
+        int64_t allocationsHighwater = 0;
+        int64_t largestAllocation = 0; // high-water mark of a single request
+        int64_t pageCacheUsed = 0; // pages used in the SQLITE_CONFIG_PAGECACHE buffer
+        int64_t pageCacheUsedHighwater = 0;
+        int64_t pageCacheOverflow = 0; // bytes of page cache that did not fit the buffer
+        int64_t pageCacheOverflowHighwater = 0;
+    };
+
+    static MemoryStats memoryStats(bool resetHighwater = false);
+
+    // memory of this connection from sqlite3_db_status()
+    struct ConnectionMemoryStats {
+        int cacheUsed = 0; // bytes of page cache
+        int schemaUsed = 0;
+        int statementUsed = 0; // prepared statements
+        int lookasideUsed = 0; // slots
+        int lookasideHighwater = 0;
+    };
+
+    ConnectionMemoryStats connectionMemoryStats(bool resetHighwater = false) const;
+
     SQLite() {}
     SQLite(const std::string& dbName, OpenFlags flags = OpenFlags::None) { open(dbName, flags); }
+    SQLite(const std::string& dbName, OpenFlags flags, const OpenOptions& options) { open(dbName, flags, options); }
 
     ~SQLite();
 
-    SQLite(SQLite&& other) noexcept : db(other.db) { other.db = nullptr; }
-    SQLite& operator=(SQLite&& other) noexcept { if (this != &other) { close(); db = other.db; other.db = nullptr; } return *this; }
+    SQLite(SQLite&& other) noexcept
+        : db(other.db), statementCache_(std::move(other.statementCache_)), savepointDepth(other.savepointDepth),
+        busyHandler(std::move(other.busyHandler)), profiler(std::move(other.profiler)), planGuard(std::move(other.planGuard)),
+        progress(std::move(other.progress)) {
+        other.db = nullptr;
+        other.savepointDepth = 0;
+    }
+    SQLite& operator=(SQLite&& other) noexcept {
+        if (this != &other) {
+            close();
+            db = other.db;
+            other.db = nullptr;
+            statementCache_ = std::move(other.statementCache_);
+            savepointDepth = other.savepointDepth;
+            other.savepointDepth = 0;
+            busyHandler = std::move(other.busyHandler);
+            profiler = std::move(other.profiler);
+            planGuard = std::move(other.planGuard);
+            progress = std::move(other.progress);
+        }
+        return *this;
+    }
 
     // delete copy constructor and copy assignment operator
     SQLite(const SQLite&) = delete;
     SQLite& operator=(const SQLite&) = delete;
 
     void open(const std::string& dbName, OpenFlags flags = OpenFlags::None);
+    // open and apply options, the connection is closed again if any option fails
+    void open(const std::string& dbName, OpenFlags flags, const OpenOptions& options);
     void close();
 
+    // effective values of the OpenOptions pragmas (lookaside is not readable and left unset)
+    OpenOptions getOptions() const;
+
+    // busy handling: how long to retry when another connection holds a conflicting lock
+
+    struct BusyPolicy {
+        std::chrono::milliseconds timeout{5000}; // give up (BusyError) after waiting this long per lock
+        std::chrono::microseconds initialDelay{1000};
+        std::chrono::microseconds maxDelay{100000};
+        double multiplier = 2.0; // exponential backoff factor
+        bool jitter = true; // randomize each delay within [delay / 2, delay]
+        int maxRetries = -1; // -1 for no limit other than timeout
+    };
+
+    struct BusyStats {
+        // upper bounds (inclusive, microseconds) of the wait histogram buckets, the last bucket is unbounded
+        static constexpr std::array<int64_t, 13> bucketBounds = {
+            100, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 5000000
+        };
+
+        uint64_t events = 0; // lock conflicts that invoked the busy handler
+        uint64_t retries = 0; // busy handler invocations
+        uint64_t timeouts = 0; // conflicts given up on (SQLITE_BUSY returned)
+        uint64_t waitMicros = 0; // total time spent waiting
+        std::array<uint64_t, bucketBounds.size() + 1> histogram = {}; // conflicts by total wait time
+    };
+
+    // install backoff busy handler with statistics, kept across close()/open()
+    void setBusyPolicy(const BusyPolicy& policy);
+    // plain sqlite3_busy_timeout(), replaces a busy policy
+    void setBusyTimeout(std::chrono::milliseconds timeout);
+    // remove busy handler, lock conflicts fail immediately with BusyError
+    void clearBusyHandler();
+
+    BusyStats busyStats() const;
+
+    // per-SQL profiling through sqlite3_trace_v2(SQLITE_TRACE_PROFILE) and sqlite3_stmt_status(),
+    // the statement status counters are reset after each run while profiling is enabled;
+    // durations come from the VFS clock, which on most platforms has millisecond resolution
+
+    struct QueryProfile {
+        // upper bounds (inclusive, microseconds) of the latency histogram buckets: 1, 2, 4, ... 2^30
+        static constexpr size_t buckets = 32;
+        static constexpr int64_t bucketBound(size_t bucket) { return bucket + 1 < buckets ? int64_t(1) << bucket : INT64_MAX; }
+
+        std::string sql;
+        uint64_t calls = 0; // completed runs
+        uint64_t totalNanos = 0;
+        uint64_t maxNanos = 0;
+        uint64_t rows = 0; // only counted with ProfilerOptions::countRows
+        uint64_t fullScanSteps = 0;
+        uint64_t sorts = 0;
+        uint64_t autoIndexes = 0;
+        uint64_t vmSteps = 0;
+        std::array<uint64_t, buckets> histogram = {};
+
+        // latency percentile estimate in microseconds (upper bound of the bucket), p in [0, 1]
+        int64_t percentile(double p) const;
+    };
+
+    struct SlowQuery {
+        std::string_view sql;
+        std::string expandedSql; // with bound parameter values
+        std::chrono::nanoseconds duration;
+        uint64_t rows;
+        uint64_t fullScanSteps;
+        uint64_t sorts;
+        uint64_t autoIndexes;
+        uint64_t vmSteps;
+    };
+
+    struct ProfilerOptions {
+        bool countRows = false; // adds a trace callback per result row
+        std::chrono::nanoseconds slowQueryThreshold{0}; // 0 disables onSlowQuery
+        std::function<void(const SlowQuery&)> onSlowQuery; // called on the connection's thread, exceptions are dropped
+    };
+
+    void enableProfiling();
+    void enableProfiling(const ProfilerOptions& options); // kept across close()/open()
+    void disableProfiling();
+
+    std::vector<QueryProfile> profileSnapshot() const; // safe to call from any thread
+    void resetProfiles();
+
+    // interrupting running statements, checked through sqlite3_progress_handler() every progressInterval virtual
+    // machine instructions (so short statements may complete anyway); an interrupted step throws InterruptedError,
+    // and if it was writing inside an explicit transaction SQLite rolls the whole transaction back
+
+    // sqlite3_interrupt(), stops the statements running right now; safe to call from any thread while open
+    void interrupt();
+
+    // handle to cancel this connection's statements from other threads, copies share the state and stay safe
+    // to use after the connection is closed or destroyed; while cancelled every statement that runs long enough
+    // to reach the progress handler is interrupted, until reset()
+    class CancellationToken {
+    public:
+        CancellationToken() {}
+
+        void cancel() const;
+        void reset() const;
+        bool isCancelled() const;
+
+    private:
+        friend class SQLite;
+
+        struct State {
+            std::atomic<bool> cancelled{false};
+            std::mutex mutex; // guards db against close()
+            struct sqlite3* db = nullptr;
+        };
+
+        explicit CancellationToken(std::shared_ptr<State> state) : state(std::move(state)) {}
+
+        std::shared_ptr<State> state;
+    };
+
+    CancellationToken cancellationToken();
+
+    // deadline for every statement stepped on the connection while it is in scope, nested deadlines
+    // keep the earliest; restores the previous deadline on destruction (destroy in reverse order)
+    class Deadline {
+    public:
+        Deadline(SQLite& db, std::chrono::steady_clock::time_point deadline);
+        ~Deadline();
+
+        Deadline(const Deadline&) = delete;
+        Deadline& operator=(const Deadline&) = delete;
+
+        bool expired() const { return std::chrono::steady_clock::now() >= deadline; }
+
+    private:
+        SQLite* db;
+        std::chrono::steady_clock::time_point deadline;
+        std::chrono::steady_clock::time_point previous;
+    };
+
+    Deadline withDeadline(std::chrono::steady_clock::time_point deadline) { return Deadline(*this, deadline); }
+    Deadline withTimeout(std::chrono::steady_clock::duration timeout) { return Deadline(*this, std::chrono::steady_clock::now() + timeout); }
+
+    // custom progress check returning true to interrupt, called on the connection's thread; kept across close()/open()
+    void setProgressHandler(std::function<bool()> handler);
+    void clearProgressHandler();
+    void setProgressInterval(int instructions); // default 1000
+
+    // EXPLAIN QUERY PLAN output as a tree, details are SQLite's text such as "SCAN t",
+    // "SEARCH t USING INDEX t_a (a=?)" or "USE TEMP B-TREE FOR ORDER BY"
+    struct QueryPlan {
+        struct Node {
+            int id = 0;
+            std::string detail;
+            std::vector<Node> children;
+
+            bool isScan() const; // full scan of a table (over its rows or a whole index), not of a constant row or subquery
+            bool isSearch() const;
+            bool usesAutomaticIndex() const;
+            bool usesTempBTree() const;
+            std::string_view table() const; // scanned or searched table, empty for other nodes
+            std::string_view index() const; // index used, "INTEGER PRIMARY KEY" for rowid lookups, empty for none
+        };
+
+        std::vector<Node> nodes; // top level steps in order
+
+        // visit every node depth first, parents before children
+        template<typename F>
+        void forEach(F&& f) const { forEach(nodes, f); }
+
+        bool usesIndex(std::string_view index) const;
+        bool hasFullScan() const;
+        bool hasFullScan(std::string_view table) const;
+        bool usesAutomaticIndex() const;
+        bool usesTempBTree() const;
+
+        std::string toString() const; // indented, one node per line
+
+    private:
+        template<typename F>
+        static void forEach(const std::vector<Node>& nodes, F& f) {
+            for (const auto& node : nodes) {
+                f(node);
+                forEach(node.children, f);
+            }
+        }
+    };
+
+    // sqlite3_stmt_status() counters since the statement was prepared or the counters were last reset;
+    // while profiling is enabled they are reset after every run
+    struct StatementStatus {
+        uint64_t fullScanSteps = 0; // steps through a table in a full scan, nonzero means an index was not used
+        uint64_t sorts = 0;
+        uint64_t autoIndexes = 0; // rows inserted into automatic indexes
+        uint64_t vmSteps = 0;
+    };
+
     class Statement;
+    class StatementCache;
+    class Script;
+    class BulkInserter;
+    template<typename ParamList, typename ColumnList> class TypedStatement;
+
+    // plan checks run on every statement prepared through prepare() and on prepareCached() cache misses,
+    // meant for tests and debug builds since each check prepares an EXPLAIN QUERY PLAN of the statement
+    struct PlanGuard {
+        bool forbidFullScans = false;
+        std::vector<std::string> allowedScans; // tables that may still be scanned, such as small lookup tables
+        bool forbidAutomaticIndexes = false;
+        std::function<void(const Statement&, const QueryPlan&)> check; // custom check, throws to reject the statement
+    };
+
+    void setPlanGuard(const PlanGuard& guard); // kept across close()/open()
+    void clearPlanGuard();
 
     // class to encapsulate column operations
     class Column {
@@ -115,6 +549,7 @@ public:
         int64_t getInt64() const { return statement.getInt64(index); }
         double getDouble() const { return statement.getDouble(index); }
         std::string getString() const { return statement.getString(index); }
+        std::string_view getStringView() const { return statement.getStringView(index); }
         Blob getBlob() const { return statement.getBlob(index); }
 
         template <typename T> T get() const {
@@ -122,6 +557,7 @@ public:
                           std::is_same_v<T, int64_t> ||
                           std::is_same_v<T, double> ||
                           std::is_same_v<T, std::string> ||
+                          std::is_same_v<T, std::string_view> ||
                           std::is_same_v<T, Blob>, "Unsupported type");
             return T();
         }
@@ -165,8 +601,11 @@ public:
             void operator=(int64_t value) { statement.bind(index, value); }
             void operator=(double value) { statement.bind(index, value); }
             void operator=(const std::string& value) { statement.bind(index, value); }
+            void operator=(std::string&& value) { statement.bind(index, std::move(value)); }
+            void operator=(std::string_view value) { statement.bind(index, value); }
             void operator=(const char* value) { statement.bind(index, value); }
             void operator=(const Blob& value) { statement.bind(index, value); }
+            void operator=(ZeroBlob value) { statement.bind(index, value); }
             std::string name() const { return statement.getParamName(index); }
             const int index;
         };
@@ -175,6 +614,7 @@ public:
 
         int getParamIndex(const std::string& paramName) const;
         std::string getParamName(int index) const;
+        int paramCount() const; // largest parameter index
 
         Parameter param(int index) { return Parameter(*this, index); }
         Parameter param(const std::string& paramName) { return Parameter(*this, getParamIndex(paramName)); }
@@ -184,34 +624,55 @@ public:
         void bind(int index, int64_t value);
         void bind(int index, double value);
         void bind(int index, const std::string& value);
+        void bind(int index, std::string_view value);
+        void bind(int index, const char* value);
         void bind(int index, const Blob& value);
+        void bind(int index, ZeroBlob value);
+        void bind(int index, std::nullptr_t); // NULL
+
+        // bind without copying, see SQLite::Borrowed
+        void bind(int index, std::string_view value, Borrowed);
+        void bind(int index, const Blob& value, Borrowed);
+
+        // bind without copying, the statement takes ownership of the buffer until rebound, cleared or finalized
+        void bind(int index, std::string&& value);
+        void bind(int index, std::vector<std::byte>&& value);
 
         void bind(const std::string& name, int value) { bind(getParamIndex(name), value); }
         void bind(const std::string& name, int64_t value) { bind(getParamIndex(name), value); }
         void bind(const std::string& name, double value) { bind(getParamIndex(name), value); }
         void bind(const std::string& name, const std::string& value) { bind(getParamIndex(name), value); }
+        void bind(const std::string& name, std::string_view value) { bind(getParamIndex(name), value); }
+        void bind(const std::string& name, const char* value) { bind(getParamIndex(name), value); }
         void bind(const std::string& name, const Blob& value) { bind(getParamIndex(name), value); }
-
-        // bind all arguments by position
+        void bind(const std::string& name, ZeroBlob value) { bind(getParamIndex(name), value); }
+        void bind(const std::string& name, std::nullptr_t) { bind(getParamIndex(name), nullptr); }
+        void bind(const std::string& name, std::string_view value, Borrowed) { bind(getParamIndex(name), value, borrowed); }
+        void bind(const std::string& name, const Blob& value, Borrowed) { bind(getParamIndex(name), value, borrowed); }
+        void bind(const std::string& name, std::string&& value) { bind(getParamIndex(name), std::move(value)); }
+        void bind(const std::string& name, std::vector<std::byte>&& value) { bind(getParamIndex(name), std::move(value)); }
+
+        // bind all arguments by position, rvalue strings and byte vectors are moved into the statement
         template<typename... Args>
-        void bindAll(Args... args) { bindHelper(1, args...); }
+        void bindAll(Args&&... args) { bindHelper(1, std::forward<Args>(args)...); }
 
         // get results (columns) for current row
 
         Column operator[](int index) const { return Column(*this, index); }
         Column operator[](const std::string& columnName) const { return Column(*this, getColumnIndex(columnName)); }
+        Column operator[](std::string_view columnName) const { return Column(*this, getColumnIndex(columnName)); }
         Column operator[](const char* columnName) const { return Column(*this, getColumnIndex(columnName)); }
 
         int columnCount() const;
         int count() const { return columnCount(); }
 
-        int getColumnIndex(const std::string& columnName) const; // get column index by name
+        int getColumnIndex(std::string_view columnName) const; // get column index by name
 
         DataType getColumnType(int index) const;
         std::string getColumnDeclType(int index) const;
 
-        DataType getColumnType(const std::string& name) const { return getColumnType(getColumnIndex(name)); }
-        std::string getColumnDeclType(const std::string& name) const { return getColumnDeclType(getColumnIndex(name)); }
+        DataType getColumnType(std::string_view name) const { return getColumnType(getColumnIndex(name)); }
+        std::string getColumnDeclType(std::string_view name) const { return getColumnDeclType(getColumnIndex(name)); }
 
         std::string getColumnName(int index) const;
 
@@ -219,21 +680,23 @@ public:
         std::string getColumnTableName(int index) const;
         std::string getColumnDatabaseName(int index) const;
 
-        std::string getColumnOriginName(const std::string& name) const { return getColumnOriginName(getColumnIndex(name)); }
-        std::string getColumnTableName(const std::string& name) const { return getColumnTableName(getColumnIndex(name)); }
-        std::string getColumnDatabaseName(const std::string& name) const { return getColumnDatabaseName(getColumnIndex(name)); }
+        std::string getColumnOriginName(std::string_view name) const { return getColumnOriginName(getColumnIndex(name)); }
+        std::string getColumnTableName(std::string_view name) const { return getColumnTableName(getColumnIndex(name)); }
+        std::string getColumnDatabaseName(std::string_view name) const { return getColumnDatabaseName(getColumnIndex(name)); }
 
         int getInt(int columnIndex) const;
         int64_t getInt64(int columnIndex) const;
         double getDouble(int columnIndex) const;
         std::string getString(int columnIndex) const;
+        std::string_view getStringView(int columnIndex) const; // valid until next step(), reset() or finalize()
         Blob getBlob(int columnIndex) const;
 
-        int getInt(const std::string& name) const { return getInt(getColumnIndex(name)); }
-        int64_t getInt64(const std::string& name) const { return getInt64(getColumnIndex(name)); }
-        double getDouble(const std::string& name) const { return getDouble(getColumnIndex(name)); }
-        std::string getString(const std::string& name) const { return getString(getColumnIndex(name)); }
-        Blob getBlob(const std::string& name) const { return getBlob(getColumnIndex(name)); }
+        int getInt(std::string_view name) const { return getInt(getColumnIndex(name)); }
+        int64_t getInt64(std::string_view name) const { return getInt64(getColumnIndex(name)); }
+        double getDouble(std::string_view name) const { return getDouble(getColumnIndex(name)); }
+        std::string getString(std::string_view name) const { return getString(getColumnIndex(name)); }
+        std::string_view getStringView(std::string_view name) const { return getStringView(getColumnIndex(name)); }
+        Blob getBlob(std::string_view name) const { return getBlob(getColumnIndex(name)); }
 
 
         bool step();
@@ -249,37 +712,1878 @@ public:
         // statement prepared/not empty
         operator bool() const { return stmt != nullptr; }
 
+        // underlying statement for sqlite3_* calls the wrapper does not cover (or as a baseline), still owned here
+        struct sqlite3_stmt* handle() const { return stmt; }
+
+        std::string sql() const;
+
+        // plan of this statement, prepared separately so bindings and the current run are not touched
+        QueryPlan explainQueryPlan() const;
+
+        // throw PlanError unless the plan uses the index / scans no table
+        void requireIndex(std::string_view index) const;
+        void requireNoFullScan() const;
+
+        StatementStatus status() const;
+        StatementStatus resetStatus(); // returns the counters before the reset
+
+        // step up to maxRows rows into batch, reusing its buffers; column types are taken from batch if set,
+        // otherwise from the first row (declared type for NULLs), values of other types are converted;
+        // returns the number of rows fetched, 0 when done
+        size_t fetchBatch(ColumnBatch& batch, size_t maxRows);
+        ColumnBatch fetchBatch(size_t maxRows) { ColumnBatch batch; fetchBatch(batch, maxRows); return batch; }
+
+        // export the remaining rows as an Arrow C stream of struct arrays (one child per column), batches are
+        // handed over without copying; the first batch is fetched here to fix the column types, the statement
+        // must outlive the stream and not be used while it is open
+        void exportArrow(ArrowArrayStream* out, size_t batchRows = 65536);
+
+        // typed column value, T is one of int, int64_t, double, std::string, std::string_view, Blob
+        // or std::optional of those (std::nullopt for NULL)
+        template<typename T>
+        T get(int index) const { ensure(); return column<T>(index); }
+
+        // range over remaining rows with column types fixed at compile time, stepping the statement:
+        // for (auto [id, name] : stmt.rows<int64_t, std::string_view>()) { ... }
+        template<typename Row, typename... Ts>
+        class RowRange {
+        public:
+            class iterator {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type = Row;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const Row*;
+                using reference = Row;
+
+                iterator() {}
+
+                Row operator*() const { return statement->decodeRow<Row, Ts...>(std::index_sequence_for<Ts...>()); }
+
+                iterator& operator++() { if (!statement->step()) statement = nullptr; return *this; }
+                void operator++(int) { ++*this; }
+
+                bool operator==(const iterator& other) const { return statement == other.statement; }
+                bool operator!=(const iterator& other) const { return statement != other.statement; }
+
+            private:
+                friend class RowRange;
+
+                explicit iterator(Statement* statement) : statement(statement) { ++*this; }
+
+                Statement* statement = nullptr; // nullptr at end
+            };
+
+            explicit RowRange(Statement& statement) : statement(statement) {}
+
+            iterator begin() { return iterator(&statement); } // steps to the first row
+            iterator end() { return iterator(); }
+
+        private:
+            Statement& statement;
+        };
+
+        template<typename... Ts>
+        RowRange<std::tuple<Ts...>, Ts...> rows() { checkRowColumns(sizeof...(Ts)); return RowRange<std::tuple<Ts...>, Ts...>(*this); }
+
+        // rows as aggregates, Row is brace-initialized from the typed columns: Row{col0, col1, ...}
+        template<typename Row, typename... Ts>
+        RowRange<Row, Ts...> rowsAs() { checkRowColumns(sizeof...(Ts)); return RowRange<Row, Ts...>(*this); }
+
     private:
+        friend class StatementCache;
+        friend class Script;
+        friend class BulkInserter;
+        template<typename, typename> friend class TypedStatement;
+
+        explicit Statement(struct sqlite3_stmt* stmt) : stmt(stmt) {} // takes ownership
+
+        void resetQuietly() noexcept; // reset without reporting the error of a failed last step
+
+        // column value without ensure(), types other than std::optional are specialized below the class
+        template<typename T>
+        T column(int index) const {
+            if constexpr (IsOptional<T>::value) {
+                return isNull(index) ? T() : T(column<typename T::value_type>(index));
+            } else {
+                static_assert(std::is_same_v<T, int> ||
+                              std::is_same_v<T, int64_t> ||
+                              std::is_same_v<T, double> ||
+                              std::is_same_v<T, std::string> ||
+                              std::is_same_v<T, std::string_view> ||
+                              std::is_same_v<T, Blob>, "Unsupported type");
+                return columnValue<T>(index);
+            }
+        }
+
+        template<typename T> T columnValue(int index) const;
+
+        bool isNull(int index) const;
+
+        template<typename Row, typename... Ts, size_t... I>
+        Row decodeRow(std::index_sequence<I...>) const { return Row{column<Ts>(static_cast<int>(I))...}; }
+
+        void checkRowColumns(size_t count) const;
+
         struct sqlite3_stmt* stmt = nullptr;
 
-        std::unordered_map<std::string, int> columnIndices;
+        // column name -> index, built on the first lookup by name and shared by statements of the same SQL
+        struct ColumnMap;
+        mutable std::shared_ptr<const ColumnMap> columnMap;
+
+        bool batchDone = false; // fetchBatch() reached the end, cleared by reset()
+
+        // buffers owned by bound parameters, indexed by parameter index - 1
+        std::vector<std::variant<std::monostate, std::string, std::vector<std::byte>>> ownedBindings;
 
         // disable copying
         Statement(const Statement&) = delete;
         Statement& operator=(const Statement&) = delete;
 
-        void initializeColumnIndices();
+        const ColumnMap& columns() const;
 
         // helper function to bind arguments
         template<typename T, typename... Args>
-        void bindHelper(int index, T value, Args... args) { bind(index, value); bindHelper(index + 1, args...); }
+        void bindHelper(int index, T&& value, Args&&... args) {
+            bind(index, std::forward<T>(value));
+            bindHelper(index + 1, std::forward<Args>(args)...);
+        }
         void bindHelper(int index) {} // final bind call for recursion termination
 
         void ensure() const { if (stmt == nullptr) throw OtherError("SQLite statement not initialized"); }
     };
 
-    Statement prepare(const std::string& sql, bool persistent = false) { ensure(); return Statement(db, sql, persistent); }
+    class CachedStatement;
+
+    struct StatementCacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t size = 0; // number of cached statements (idle and checked out)
+        size_t capacity = 0;
+    };
+
+    // LRU cache of prepared statements keyed by SQL text, owned by the connection
+    class StatementCache {
+    public:
+        explicit StatementCache(size_t capacity = 32) : capacity(capacity) {}
+        ~StatementCache() { clear(); }
+
+        StatementCache(const StatementCache&) = delete;
+        StatementCache& operator=(const StatementCache&) = delete;
+
+        // check out a statement for sql, preparing it on a miss
+        CachedStatement acquire(struct sqlite3* db, const std::string& sql);
+
+        // run on every statement prepared on a miss before it is cached, throws to reject it
+        void setPrepareCheck(std::function<void(const Statement&)> check) { prepareCheck = std::move(check); }
+
+        // setting capacity to 0 disables caching (every statement is finalized on release)
+        void setCapacity(size_t capacity);
+        size_t getCapacity() const { return capacity; }
+
+        StatementCacheStats stats() const;
+
+        // finalize idle statements; statements still checked out are finalized on release
+        void clear();
+
+    private:
+        friend class CachedStatement;
+
+        struct Entry {
+            std::string sql;
+            Statement statement;
+            bool cached = false; // entry is tracked by index
+            bool checkedOut = false;
+        };
+
+        using List = std::list<Entry>;
+
+        List idle; // idle statements, most recently used first
+        std::unordered_map<std::string_view, List::iterator> index; // keys point into Entry::sql
+
+        size_t capacity;
+        std::function<void(const Statement&)> prepareCheck;
+        uint64_t generation = 0; // bumped by clear() to invalidate checked out statements
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+
+        void release(List& node, uint64_t generation) noexcept;
+        void evict();
+    };
+
+    // statement checked out of a StatementCache, returned to the cache (reset, bindings cleared) on destruction
+    class CachedStatement {
+    public:
+        CachedStatement() {}
+        ~CachedStatement() { release(); }
+
+        CachedStatement(CachedStatement&& other) noexcept
+            : cache(other.cache), node(std::move(other.node)), generation(other.generation) { other.cache = nullptr; }
+        CachedStatement& operator=(CachedStatement&& other) noexcept {
+            if (this != &other) {
+                release();
+                cache = other.cache;
+                node = std::move(other.node);
+                generation = other.generation;
+                other.cache = nullptr;
+            }
+            return *this;
+        }
+
+        CachedStatement(const CachedStatement&) = delete;
+        CachedStatement& operator=(const CachedStatement&) = delete;
+
+        Statement& statement() { return node.front().statement; }
+        const Statement& statement() const { return node.front().statement; }
+
+        Statement& operator*() { return statement(); }
+        const Statement& operator*() const { return statement(); }
+        Statement* operator->() { return &statement(); }
+        const Statement* operator->() const { return &statement(); }
+
+        // return statement to the cache early
+        void release() noexcept { if (cache) { cache->release(node, generation); cache = nullptr; } }
+
+        operator bool() const { return cache != nullptr && !node.empty() && node.front().statement; }
+
+    private:
+        friend class StatementCache;
+
+        CachedStatement(StatementCache* cache, StatementCache::List&& node, uint64_t generation)
+            : cache(cache), node(std::move(node)), generation(generation) {}
+
+        StatementCache* cache = nullptr;
+        StatementCache::List node; // single checked out entry, spliced to and from the cache
+        uint64_t generation = 0;
+    };
+
+    Statement prepare(const std::string& sql, bool persistent = false) {
+        ensure();
+        Statement statement(db, sql, persistent);
+        if (planGuard) checkPlan(*planGuard, statement);
+        return statement;
+    }
+
+    // get prepared statement from the connection's statement cache (prepared as persistent on a miss)
+    CachedStatement prepareCached(const std::string& sql) { ensure(); return statementCache().acquire(db, sql); }
+
+    StatementCache& statementCache() {
+        if (!statementCache_) {
+            statementCache_ = std::make_unique<StatementCache>();
+            installPlanGuard();
+        }
+        return *statementCache_;
+    }
+
+    enum class TransactionMode {
+        Deferred,
+        Immediate,
+        Exclusive
+    };
+
+    // RAII transaction, rolled back on destruction unless committed
+    class Transaction {
+    public:
+        explicit Transaction(SQLite& db, TransactionMode mode = TransactionMode::Deferred);
+        ~Transaction();
+
+        Transaction(Transaction&& other) noexcept : db(other.db) { other.db = nullptr; }
+        Transaction& operator=(Transaction&&) = delete;
+
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+
+        void commit();
+        void rollback();
+
+        bool isActive() const { return db != nullptr; }
+
+    private:
+        SQLite* db = nullptr; // nullptr once committed or rolled back
+    };
+
+    // RAII savepoint, can be nested inside a transaction or another savepoint;
+    // rolled back and released on destruction unless released (committed)
+    class Savepoint {
+    public:
+        explicit Savepoint(SQLite& db); // name derived from the nesting depth
+        Savepoint(SQLite& db, const std::string& name);
+        ~Savepoint();
+
+        Savepoint(Savepoint&& other) noexcept : db(other.db), name(std::move(other.name)), nested(other.nested) { other.db = nullptr; }
+        Savepoint& operator=(Savepoint&&) = delete;
+
+        Savepoint(const Savepoint&) = delete;
+        Savepoint& operator=(const Savepoint&) = delete;
+
+        void release();
+        void rollback(); // roll back to the savepoint and release it
+
+        bool isActive() const { return db != nullptr; }
+
+    private:
+        SQLite* db = nullptr; // nullptr once released or rolled back
+        std::string name; // quoted identifier
+        bool nested = false; // counted in SQLite::savepointDepth
+    };
+
+#if defined(SQLITE_ENABLE_SNAPSHOT)
+    // recorded state of a WAL mode database (sqlite3_snapshot, needs SQLITE_ENABLE_SNAPSHOT) that read transactions
+    // on any connection to the same file can be opened at; it stays usable until a checkpoint overwrites it,
+    // i.e. until the WAL is restarted after every frame was checkpointed
+    class Snapshot {
+    public:
+        Snapshot() {}
+        ~Snapshot();
+
+        Snapshot(Snapshot&& other) noexcept : snapshot(other.snapshot) { other.snapshot = nullptr; }
+        Snapshot& operator=(Snapshot&& other) noexcept;
+
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        // negative if older than other, 0 for the same state, positive if newer (snapshots of the same database)
+        int compare(const Snapshot& other) const;
+
+        operator bool() const { return snapshot != nullptr; }
+
+        struct sqlite3_snapshot* handle() const { return snapshot; }
+
+    private:
+        friend class SQLite;
+
+        explicit Snapshot(struct sqlite3_snapshot* snapshot) : snapshot(snapshot) {}
+
+        struct sqlite3_snapshot* snapshot = nullptr;
+    };
+
+    // snapshot of the state this connection reads: the open read transaction's, or in autocommit mode the
+    // latest (read in a short transaction); fails until a first transaction was written to the WAL file
+    Snapshot takeSnapshot(const std::string& schema = "main");
+
+    // read transaction at snapshot, which must not be in a transaction yet; the snapshot can be
+    // freed once this returns. Throws Error with extended code SQLITE_ERROR_SNAPSHOT if it was overwritten
+    Transaction beginTransaction(const Snapshot& snapshot, const std::string& schema = "main");
+
+    // make snapshots of a WAL file left over from a previous process available again (not in a transaction)
+    void recoverSnapshots(const std::string& schema = "main");
+#endif // SQLITE_ENABLE_SNAPSHOT
+
+    Transaction beginTransaction(TransactionMode mode = TransactionMode::Deferred) { return Transaction(*this, mode); }
+    Savepoint savepoint() { return Savepoint(*this); }
+    Savepoint savepoint(const std::string& name) { return Savepoint(*this, name); }
+
+    bool inTransaction() const { ensure(); return !isAutocommit(); }
+
+    // multi-statement SQL compiled once into its statements, executed repeatedly with parameters bound by name
+    // in every statement using them; a SyntaxError's offset and sql refer to the whole script. Statements are
+    // prepared up front as far as they compile; from the first one that does not (such as an INSERT into a table
+    // the script creates), each is prepared when execute() first reaches it, after the earlier ones ran, and kept
+    class Script {
+    public:
+        Script(SQLite& db, const std::string& sql);
+
+        size_t size() const { return statements.size(); } // prepared so far, all once execute() completed
+        Statement& operator[](size_t index) { return statements.at(index); }
+        std::string_view sql(size_t index) const; // source of one statement
+
+        // bind a named parameter (":name", "@name", "$name" or "?NNN") in every statement that has it; the value
+        // is copied for statements not prepared yet
+        template<typename T>
+        void bind(const std::string& name, const T& value) {
+            for (const auto& [statement, index] : parameterIndices(name)) {
+                statements[statement].bind(index, value);
+            }
+            if (position < source.size()) {
+                deferredBindings[name] = [value = deferredValue(value)](Statement& statement, int index) {
+                    using Value = std::decay_t<decltype(value)>;
+                    if constexpr (std::is_same_v<Value, std::vector<std::byte>>) {
+                        statement.bind(index, Blob{value.data(), static_cast<int>(value.size())});
+                    } else if constexpr (std::is_same_v<Value, std::optional<std::string>>) {
+                        value ? statement.bind(index, *value) : statement.bind(index, nullptr);
+                    } else {
+                        statement.bind(index, value);
+                    }
+                };
+            }
+        }
+
+        // run every statement to completion in order, statements are reset afterwards (also on errors)
+        void execute();
+        // as execute(), calling onRow(size_t statementIndex, Statement&) for each result row
+        template<typename F>
+        void execute(F onRow) {
+            for (size_t i = 0; i < statements.size() || prepareNext(false); ++i) {
+                Statement& statement = statements[i];
+                try {
+                    while (statement.step()) {
+                        onRow(i, statement);
+                    }
+                } catch (...) {
+                    resetQuietly(statement); // the step error is the one to report
+                    throw;
+                }
+                statement.reset();
+            }
+        }
+
+        void clearBindings();
+
+    private:
+        struct sqlite3* db = nullptr;
+        std::string source;
+        size_t position = 0; // offset in source of the first statement not prepared yet
+        std::vector<Statement> statements;
+        std::vector<std::pair<size_t, size_t>> ranges; // offset and length in source per statement
+        std::unordered_map<std::string, std::vector<std::pair<size_t, int>>> parameters; // name -> statement, index
+        std::unordered_map<std::string, std::function<void(Statement&, int)>> deferredBindings; // for later statements
+
+        // prepares the statement at position, false at the end of the source or, if deferErrors, when it fails
+        bool prepareNext(bool deferErrors);
+
+        // owning copy of a bound value, views and blobs do not outlive bind()
+        template<typename T>
+        static auto deferredValue(const T& value) {
+            if constexpr (std::is_same_v<std::decay_t<T>, Blob>) {
+                const std::byte* data = static_cast<const std::byte*>(value.data);
+                return std::vector<std::byte>(data, data + value.size);
+            } else if constexpr (std::is_pointer_v<std::decay_t<T>>) {
+                return value ? std::optional<std::string>(value) : std::optional<std::string>(); // NULL if nullptr
+            } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+                return std::string(std::string_view(value));
+            } else {
+                return value;
+            }
+        }
+
+        const std::vector<std::pair<size_t, int>>& parameterIndices(const std::string& name) const;
+        static void resetQuietly(Statement& statement) noexcept;
+    };
+
+    Script prepareScript(const std::string& sql) { return Script(*this, sql); }
+
+    template<typename... Ts> struct Params {};
+    template<typename... Ts> struct Columns {};
+
+    // statement with parameter and result column types fixed at compile time, e.g.
+    // TypedStatement<Params<int64_t>, Columns<int64_t, std::string_view>>; the parameter and column counts are
+    // checked once when prepared, execute() then resets, binds by position and steps without name lookups
+    // or further checks. Parameters are the Statement::bind() types or std::optional of those (NULL if empty),
+    // columns the Statement::get<T>() types
+    template<typename... P, typename... C>
+    class TypedStatement<Params<P...>, Columns<C...>> {
+    public:
+        using Row = std::tuple<C...>;
+        using Rows = Statement::RowRange<Row, C...>;
+
+        TypedStatement() {}
+        TypedStatement(SQLite& db, const std::string& sql) : statement(db.prepare(sql, true)) {
+            if (statement.paramCount() != static_cast<int>(sizeof...(P))) {
+                throw OtherError("statement has " + std::to_string(statement.paramCount()) + " parameters, "
+                        + std::to_string(sizeof...(P)) + " declared: " + sql);
+            }
+            if (statement.columnCount() != static_cast<int>(sizeof...(C))) {
+                throw OtherError("statement returns " + std::to_string(statement.columnCount()) + " columns, "
+                        + std::to_string(sizeof...(C)) + " declared: " + sql);
+            }
+        }
+
+        // without columns the statement is run to completion and reset, otherwise the rows are returned
+        // as a range stepping the statement, valid until the next execute()
+        auto execute(const P&... args) {
+            statement.resetQuietly();
+            bindAll(std::index_sequence_for<P...>(), args...);
+            if constexpr (sizeof...(C) == 0) {
+                try {
+                    while (statement.step()) {}
+                } catch (...) {
+                    statement.resetQuietly(); // the step error is the one to report
+                    throw;
+                }
+                statement.resetQuietly();
+            } else {
+                return Rows(statement);
+            }
+        }
+
+        // first row only, the statement is reset afterwards
+        std::optional<Row> executeOne(const P&... args) {
+            static_assert(sizeof...(C) > 0, "statement has no result columns");
+            statement.resetQuietly();
+            bindAll(std::index_sequence_for<P...>(), args...);
+            std::optional<Row> row;
+            try {
+                if (statement.step()) {
+                    row.emplace(statement.decodeRow<Row, C...>(std::index_sequence_for<C...>()));
+                }
+            } catch (...) {
+                statement.resetQuietly();
+                throw;
+            }
+            statement.resetQuietly();
+            return row;
+        }
+
+        Statement& get() { return statement; }
+        operator bool() const { return static_cast<bool>(statement); }
+
+    private:
+        Statement statement;
+
+        template<size_t... I>
+        void bindAll(std::index_sequence<I...>, const P&... args) {
+            (bindValue(static_cast<int>(I) + 1, args), ...);
+        }
+
+        template<typename T>
+        void bindValue(int index, const T& value) {
+            if constexpr (IsOptional<T>::value) {
+                if (value) {
+                    bindValue(index, *value);
+                } else {
+                    statement.bind(index, nullptr);
+                }
+            } else {
+                static_assert(std::is_same_v<T, int> ||
+                              std::is_same_v<T, int64_t> ||
+                              std::is_same_v<T, double> ||
+                              std::is_same_v<T, std::string> ||
+                              std::is_same_v<T, std::string_view> ||
+                              std::is_same_v<T, const char*> ||
+                              std::is_same_v<T, Blob> ||
+                              std::is_same_v<T, ZeroBlob> ||
+                              std::is_same_v<T, std::nullptr_t>, "Unsupported parameter type");
+                statement.bind(index, value);
+            }
+        }
+    };
+
+    template<typename ParamList, typename ColumnList>
+    TypedStatement<ParamList, ColumnList> prepareTyped(const std::string& sql) { return TypedStatement<ParamList, ColumnList>(*this, sql); }
+
+    struct BulkInsertOptions {
+        size_t rowsPerTransaction = 10000; // 0 leaves transaction handling to the caller
+        size_t rowsPerStatement = 1; // rows per multi-row INSERT step, clamped to SQLITE_LIMIT_VARIABLE_NUMBER
+        std::string verb = "INSERT"; // e.g. "INSERT OR REPLACE"
+    };
+
+    struct BulkInsertStats {
+        uint64_t rows = 0; // inserted, rows of a failed step are not counted
+        uint64_t steps = 0;
+        uint64_t transactions = 0; // committed transactions
+        double seconds = 0;
+
+        double rowsPerSecond() const { return seconds > 0 ? rows / seconds : 0.0; }
+    };
+
+    // bulk insert into one table with a single reused prepared statement, rows are grouped into multi-row
+    // inserts and chunked transactions; the destructor rolls back rows not yet committed by flush() or finish().
+    // A failing step (e.g. a constraint violation) throws and drops the rows of its batch, the inserter and its
+    // open transaction stay usable for the following rows. table, columns and BulkInsertOptions::verb go into the
+    // SQL as given, like exec() SQL, so names that need quoting must be quoted by the caller
+    class BulkInserter {
+    public:
+        BulkInserter(SQLite& db, const std::string& table, const std::vector<std::string>& columns);
+        BulkInserter(SQLite& db, const std::string& table, const std::vector<std::string>& columns, const BulkInsertOptions& options);
+
+        BulkInserter(const BulkInserter&) = delete;
+        BulkInserter& operator=(const BulkInserter&) = delete;
+
+        // insert one row, values are bound in column order
+        template<typename... Args>
+        void insert(const Args&... values) {
+            beginRow(sizeof...(Args));
+            int index = static_cast<int>(pendingRows * columns) + 1;
+            (statement.bind(index++, values), ...);
+            endRow();
+        }
+
+        template<typename... Args>
+        void insert(const std::tuple<Args...>& row) { std::apply([this](const auto&... values) { insert(values...); }, row); }
+
+        // insert one row of values known at run time, bind(Statement&, int parameterIndex, size_t column) binds each
+        template<typename Bind>
+        void insertRow(size_t values, Bind bind) {
+            beginRow(values);
+            int index = static_cast<int>(pendingRows * columns) + 1;
+            for (size_t column = 0; column < values; ++column) {
+                bind(statement, index++, column);
+            }
+            endRow();
+        }
+
+        // insert a range of tuples
+        template<typename Range>
+        void insertAll(const Range& rows) { for (const auto& row : rows) insert(row); }
+
+        // insert a range of structs, projection maps each element to a tuple (e.g. with std::tie)
+        template<typename Range, typename Projection>
+        void insertAll(const Range& rows, Projection projection) { for (const auto& row : rows) insert(projection(row)); }
+
+        void flush(); // insert pending rows and commit the current transaction
+        void finish() { flush(); finished = true; } // flush and stop the throughput timer
+
+        BulkInsertStats stats() const;
+
+        size_t pending() const { return pendingRows; } // rows bound but not yet inserted (multi-row statements)
+
+    private:
+        SQLite& db;
+        Statement statement;
+        size_t columns;
+        size_t rowsPerStatement;
+        size_t rowsPerTransaction;
+
+        size_t pendingRows = 0; // rows bound but not yet stepped
+        size_t transactionRows = 0;
+        std::optional<Transaction> transaction;
+        bool started = false;
+        bool finished = false;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+        BulkInsertStats counters;
+
+        void beginRow(size_t values);
+        void endRow();
+        void stepPending();
+        void commit();
+    };
+
+    struct CsvOptions {
+        char delimiter = ',';
+        char quote = '"';
+        bool header = true; // first record holds the column names (import) or is written (export)
+        bool emptyIsNull = false; // unquoted empty fields import as NULL, otherwise both are empty text
+    };
+
+    struct TransferStats {
+        uint64_t rows = 0;
+        uint64_t bytes = 0; // file bytes read or written
+        double seconds = 0;
+
+        double rowsPerSecond() const { return seconds > 0 ? rows / seconds : 0.0; }
+        double megabytesPerSecond() const { return seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0.0; }
+    };
+
+    // load a file into table with a BulkInserter on this thread, while a second thread parses the memory-mapped
+    // file in chunks; CSV columns are named by the header (or are the table's columns without one), JSON lines
+    // columns by the keys of the first object (a missing key is NULL, nested objects and arrays are kept as JSON text);
+    // table and the column names are quoted as identifiers
+    TransferStats importCsv(const std::string& fileName, const std::string& table);
+    TransferStats importCsv(const std::string& fileName, const std::string& table, const CsvOptions& options);
+    TransferStats importCsv(const std::string& fileName, const std::string& table, const CsvOptions& options,
+            const BulkInsertOptions& insertOptions);
+    TransferStats importJsonLines(const std::string& fileName, const std::string& table);
+    TransferStats importJsonLines(const std::string& fileName, const std::string& table, const BulkInsertOptions& insertOptions);
+
+    // write all rows of statement to a file through a buffered writer, values are formatted from the column data
+    // without intermediate strings; blobs are written as hex, NULL as an empty CSV field or JSON null
+    static TransferStats exportCsv(Statement& statement, const std::string& fileName);
+    static TransferStats exportCsv(Statement& statement, const std::string& fileName, const CsvOptions& options);
+    static TransferStats exportJsonLines(Statement& statement, const std::string& fileName);
+
+    // pool of one writer and N read-only connections to the same WAL mode database file
+    class ConnectionPool {
+    public:
+        // RAII lease of a pooled connection, returned to the pool on destruction (an open transaction is rolled back)
+        class Lease {
+        public:
+            Lease() {}
+            ~Lease() { release(); }
+
+            Lease(Lease&& other) noexcept : pool(other.pool), connection(other.connection), writer(other.writer) { other.pool = nullptr; }
+            Lease& operator=(Lease&& other) noexcept {
+                if (this != &other) {
+                    release();
+                    pool = other.pool;
+                    connection = other.connection;
+                    writer = other.writer;
+                    other.pool = nullptr;
+                }
+                return *this;
+            }
+
+            Lease(const Lease&) = delete;
+            Lease& operator=(const Lease&) = delete;
+
+            SQLite& operator*() const { return *connection; }
+            SQLite* operator->() const { return connection; }
+
+            bool isWriter() const { return writer; }
+
+            void release() noexcept { if (pool) { pool->release(connection, writer); pool = nullptr; } }
+
+            operator bool() const { return pool != nullptr; }
+
+        private:
+            friend class ConnectionPool;
+
+            Lease(ConnectionPool* pool, SQLite* connection, bool writer) : pool(pool), connection(connection), writer(writer) {}
+
+            ConnectionPool* pool = nullptr;
+            SQLite* connection = nullptr;
+            bool writer = false;
+        };
+
+        // opens the writer (creating the file, switching it to WAL) and then the readers;
+        // flags are added to the open flags of every connection (e.g. URI, SharedCache)
+        ConnectionPool(const std::string& dbName, size_t readers, OpenFlags flags = OpenFlags::None);
+        // options apply to every connection (journalMode is always WAL, pageSize and walAutocheckpoint only on the writer)
+        ConnectionPool(const std::string& dbName, size_t readers, OpenFlags flags, const OpenOptions& options);
+        ~ConnectionPool() {}
+
+        ConnectionPool(const ConnectionPool&) = delete;
+        ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+        // block until a connection is available
+        Lease acquireReader();
+        Lease acquireWriter();
+
+        // return empty lease if no connection becomes available within timeout
+        Lease tryAcquireReader(std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+        Lease tryAcquireWriter(std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+        size_t readerCount() const { return readers.size(); }
+
+#if defined(SQLITE_ENABLE_SNAPSHOT)
+        // snapshot of the latest committed state, taken on a reader
+        Snapshot takeSnapshot();
+
+        // reader with a read transaction open at snapshot, rolled back when the lease is released; leases
+        // at the same snapshot on several readers see the same data while the writer and checkpoints carry on
+        Lease acquireReader(const Snapshot& snapshot);
+#endif // SQLITE_ENABLE_SNAPSHOT
+
+    private:
+        std::unique_ptr<SQLite> writer;
+        std::vector<std::unique_ptr<SQLite>> readers;
+
+        std::mutex mutex;
+        std::condition_variable readerAvailable;
+        std::condition_variable writerAvailable;
+        std::vector<SQLite*> idleReaders;
+        bool writerIdle = true;
+
+        void release(SQLite* connection, bool writer) noexcept;
+    };
+
+    struct AsyncOptions {
+        bool groupWrites = true; // run back-to-back execute() calls in one transaction
+        size_t maxWriteGroup = 64;
+    };
+
+    // runs queries on a dedicated thread that owns the connection, tasks are submitted through a lock-free queue
+    class AsyncExecutor {
+    private:
+        // queued task, run() stores the result which complete() or fail() publish
+        struct Task {
+            virtual ~Task() {}
+            virtual void run(SQLite& db) = 0;
+            virtual void complete() = 0;
+            virtual void fail(std::exception_ptr error) = 0;
+
+            std::atomic<Task*> next{nullptr};
+            bool write = false;
+            std::exception_ptr error; // run() threw
+        };
+
+        struct Stub : Task {
+            void run(SQLite&) override {}
+            void complete() override {}
+            void fail(std::exception_ptr) override {}
+        };
+
+        template<typename R, typename F>
+        struct FunctionTask : Task {
+            explicit FunctionTask(F&& function) : function(std::move(function)) {}
+            explicit FunctionTask(const F& function) : function(function) {}
+
+            void run(SQLite& db) override {
+                try {
+                    if constexpr (std::is_void_v<R>) function(db); else result.emplace(function(db));
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+            void complete() override {
+                if (error) {
+                    promise.set_exception(error);
+                } else if constexpr (std::is_void_v<R>) {
+                    promise.set_value();
+                } else {
+                    promise.set_value(std::move(*result));
+                }
+            }
+            void fail(std::exception_ptr error) override { promise.set_exception(error); }
+
+            F function;
+            std::promise<R> promise;
+            std::conditional_t<std::is_void_v<R>, bool, std::optional<R>> result;
+        };
+
+        // arguments are stored until the task runs, views and C strings are copied
+        template<typename T>
+        using AsyncArg = std::conditional_t<std::is_same_v<std::decay_t<T>, std::string_view> ||
+                std::is_same_v<std::decay_t<T>, const char*> || std::is_same_v<std::decay_t<T>, char*>,
+                std::string, std::decay_t<T>>;
+
+        template<typename... Args>
+        struct ExecuteFunction {
+            std::string sql;
+            std::tuple<Args...> params;
+
+            int operator()(SQLite& db) {
+                auto statement = db.prepareCached(sql);
+                std::apply([&](auto&... values) { statement->bindAll(std::move(values)...); }, params); // runs once
+                statement->step();
+                return db.changes();
+            }
+        };
+
+    public:
+        explicit AsyncExecutor(SQLite&& db);
+        AsyncExecutor(SQLite&& db, const AsyncOptions& options);
+        ~AsyncExecutor(); // runs the remaining tasks, then stops the thread
+
+        AsyncExecutor(const AsyncExecutor&) = delete;
+        AsyncExecutor& operator=(const AsyncExecutor&) = delete;
+
+        // run function(SQLite&) on the database thread
+        template<typename F>
+        auto submit(F&& function) {
+            using R = std::invoke_result_t<std::decay_t<F>&, SQLite&>;
+            auto task = new FunctionTask<R, std::decay_t<F>>(std::forward<F>(function));
+            auto future = task->promise.get_future();
+            enqueue(task);
+            return future;
+        }
+
+        // execute a statement, resolves to the number of changed rows once committed;
+        // adjacent execute() calls are grouped into one transaction, each one in its own savepoint
+        template<typename... Args>
+        std::future<int> execute(std::string sql, Args&&... args) {
+            auto task = new FunctionTask<int, ExecuteFunction<AsyncArg<Args>...>>(
+                ExecuteFunction<AsyncArg<Args>...>{std::move(sql), std::tuple<AsyncArg<Args>...>(std::forward<Args>(args)...)});
+            task->write = true;
+            auto future = task->promise.get_future();
+            enqueue(task);
+            return future;
+        }
+
+        // materialized typed rows, Ts must own their data (no std::string_view or Blob)
+        template<typename... Ts, typename... Args>
+        std::future<std::vector<std::tuple<Ts...>>> query(std::string sql, Args&&... args) {
+            static_assert(((!std::is_same_v<Ts, std::string_view> && !std::is_same_v<Ts, Blob>) && ...),
+                    "query() rows outlive the statement, use owning column types");
+            return submit([sql = std::move(sql), params = std::tuple<AsyncArg<Args>...>(std::forward<Args>(args)...)](SQLite& db) {
+                auto statement = db.prepareCached(sql);
+                std::apply([&](auto&... values) { statement->bindAll(std::move(values)...); }, params); // runs once
+                std::vector<std::tuple<Ts...>> rows;
+                for (auto&& row : statement->rows<Ts...>()) {
+                    rows.push_back(std::move(row));
+                }
+                return rows;
+            });
+        }
+
+        // stream rows in chunks of up to chunkRows to onChunk(std::vector<std::tuple<Ts...>>&&),
+        // called on the database thread; resolves to the total number of rows
+        template<typename... Ts, typename Callback, typename... Args>
+        std::future<size_t> queryChunks(std::string sql, size_t chunkRows, Callback onChunk, Args&&... args) {
+            static_assert(((!std::is_same_v<Ts, std::string_view> && !std::is_same_v<Ts, Blob>) && ...),
+                    "chunks outlive the row, use owning column types");
+            return submit([sql = std::move(sql), chunkRows, onChunk = std::move(onChunk),
+                    params = std::tuple<AsyncArg<Args>...>(std::forward<Args>(args)...)](SQLite& db) mutable {
+                auto statement = db.prepareCached(sql);
+                std::apply([&](auto&... values) { statement->bindAll(std::move(values)...); }, params); // runs once
+                size_t total = 0;
+                std::vector<std::tuple<Ts...>> chunk;
+                chunk.reserve(chunkRows);
+                for (auto&& row : statement->rows<Ts...>()) {
+                    chunk.push_back(std::move(row));
+                    if (chunk.size() >= chunkRows) {
+                        total += chunk.size();
+                        onChunk(std::move(chunk));
+                        chunk.clear();
+                        chunk.reserve(chunkRows);
+                    }
+                }
+                if (!chunk.empty()) {
+                    total += chunk.size();
+                    onChunk(std::move(chunk));
+                }
+                return total;
+            });
+        }
+
+#if defined(__cpp_impl_coroutine)
+        // co_await executor.async([](SQLite& db) { ... }); the coroutine is resumed on the database thread
+        template<typename R, typename F>
+        class Awaitable {
+        public:
+            Awaitable(AsyncExecutor& executor, F&& function) : executor(executor), function(std::move(function)) {}
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { executor.enqueue(new AwaitTask(*this, handle)); }
+            R await_resume() {
+                if (error) std::rethrow_exception(error);
+                if constexpr (!std::is_void_v<R>) return std::move(*result);
+            }
+
+        private:
+            struct AwaitTask : Task {
+                AwaitTask(Awaitable& awaitable, std::coroutine_handle<> handle) : awaitable(awaitable), handle(handle) {}
+                void run(SQLite& db) override {
+                    try {
+                        if constexpr (std::is_void_v<R>) awaitable.function(db); else awaitable.result.emplace(awaitable.function(db));
+                    } catch (...) {
+                        error = std::current_exception();
+                        awaitable.error = error;
+                    }
+                }
+                void complete() override { handle.resume(); }
+                void fail(std::exception_ptr error) override { awaitable.error = error; handle.resume(); }
+                Awaitable& awaitable;
+                std::coroutine_handle<> handle;
+            };
+
+            AsyncExecutor& executor;
+            F function;
+            std::conditional_t<std::is_void_v<R>, bool, std::optional<R>> result;
+            std::exception_ptr error;
+        };
+
+        template<typename F>
+        auto async(F&& function) {
+            using R = std::invoke_result_t<std::decay_t<F>&, SQLite&>;
+            return Awaitable<R, std::decay_t<F>>(*this, std::decay_t<F>(std::forward<F>(function)));
+        }
+#endif
+
+    private:
+        std::unique_ptr<SQLite> db;
+        AsyncOptions options;
+
+        // intrusive multi-producer single-consumer queue (Vyukov), consumer side is only touched by the worker
+        Stub stub;
+        std::atomic<Task*> head{&stub};
+        Task* tail = &stub;
+
+        std::atomic<bool> sleeping{false};
+        std::atomic<bool> stopping{false};
+        std::mutex mutex;
+        std::condition_variable wake;
+
+        std::thread worker;
+
+        void enqueue(Task* task);
+        void push(Task* task);
+        Task* pop();
+        void run();
+        void runWriteGroup(std::vector<std::unique_ptr<Task>>& group);
+    };
+
+    // one connection per shard database, the same SQL runs on all shards in parallel on a shared thread pool
+    class ShardedExecutor {
+    public:
+        // threads = 0 uses min(shards, hardware threads)
+        ShardedExecutor(const std::vector<std::string>& dbNames, OpenFlags flags = OpenFlags::ReadOnly, size_t threads = 0);
+        ~ShardedExecutor();
+
+        ShardedExecutor(const ShardedExecutor&) = delete;
+        ShardedExecutor& operator=(const ShardedExecutor&) = delete;
+
+        size_t shardCount() const { return shards.size(); }
+
+        // run function(shard, SQLite&) on every shard, results in shard order (none for void functions);
+        // the first exception is rethrown
+        template<typename F>
+        auto forEach(F function) {
+            using R = std::invoke_result_t<F&, size_t, SQLite&>;
+            std::vector<std::future<R>> futures;
+            futures.reserve(shards.size());
+            for (size_t i = 0; i < shards.size(); ++i) {
+                futures.push_back(run(i, [function, i](SQLite& db) mutable { return function(i, db); }));
+            }
+            return collect(futures);
+        }
+
+        // run sql on every shard, bind(shard, Statement&) sets per-shard parameters,
+        // combine(Result&, std::vector<std::tuple<Ts...>>&&) merges each shard's rows in shard order
+        template<typename... Ts, typename Bind, typename Result, typename Combine>
+        Result query(const std::string& sql, Bind bind, Result init, Combine combine) {
+            static_assert(((!std::is_same_v<Ts, std::string_view> && !std::is_same_v<Ts, Blob>) && ...),
+                    "rows outlive the statement, use owning column types");
+            auto results = forEach([&sql, &bind](size_t shard, SQLite& db) {
+                auto statement = db.prepareCached(sql);
+                bind(shard, *statement);
+                std::vector<std::tuple<Ts...>> rows;
+                for (auto&& row : statement->rows<Ts...>()) {
+                    rows.push_back(std::move(row));
+                }
+                return rows;
+            });
+            for (auto& rows : results) {
+                combine(init, std::move(rows));
+            }
+            return init;
+        }
+
+        // k-way merge of sql results that are ordered by less on every shard (ORDER BY), calling
+        // onRow(const std::tuple<Ts...>&) in global order on the calling thread; onRow may return false to stop;
+        // shards are read in chunks of chunkRows, the next chunk of each shard is prefetched on the pool
+        template<typename... Ts, typename Bind, typename Less, typename Callback>
+        void merge(const std::string& sql, Bind bind, Less less, Callback onRow, size_t chunkRows = 256) {
+            static_assert(((!std::is_same_v<Ts, std::string_view> && !std::is_same_v<Ts, Blob>) && ...),
+                    "rows outlive the statement, use owning column types");
+            using Row = std::tuple<Ts...>;
+            using Chunk = std::vector<Row>;
+
+            struct Cursor {
+                std::optional<CachedStatement> statement;
+                Chunk chunk;
+                size_t position = 0;
+                std::future<Chunk> next;
+            };
+
+            std::vector<Cursor> cursors(shards.size());
+            auto fetch = [this, &cursors, chunkRows](size_t shard) {
+                return run(shard, [&cursor = cursors[shard], chunkRows](SQLite&) {
+                    Chunk chunk;
+                    chunk.reserve(chunkRows);
+                    for (auto&& row : cursor.statement->statement().template rows<Ts...>()) {
+                        chunk.push_back(std::move(row));
+                        if (chunk.size() >= chunkRows) {
+                            break;
+                        }
+                    }
+                    return chunk;
+                });
+            };
+
+            // on exit (also by exception), wait for prefetches and release statements on their shard
+            struct Cleanup {
+                ShardedExecutor& executor;
+                std::vector<Cursor>& cursors;
+                ~Cleanup() {
+                    for (size_t i = 0; i < cursors.size(); ++i) {
+                        if (cursors[i].next.valid()) {
+                            cursors[i].next.wait();
+                        }
+                        std::lock_guard<std::mutex> lock(*executor.shards[i].mutex);
+                        cursors[i].statement.reset();
+                    }
+                }
+            } cleanup{*this, cursors};
+
+            forEach([&sql, &bind, &cursors](size_t shard, SQLite& db) {
+                cursors[shard].statement.emplace(db.prepareCached(sql));
+                bind(shard, cursors[shard].statement->statement());
+            });
+
+            for (size_t i = 0; i < cursors.size(); ++i) {
+                cursors[i].next = fetch(i);
+            }
+
+            // advance cursor to its next row, false when the shard is exhausted
+            auto advance = [&](size_t shard) {
+                Cursor& cursor = cursors[shard];
+                if (++cursor.position < cursor.chunk.size()) {
+                    return true;
+                }
+                if (!cursor.next.valid()) {
+                    return false;
+                }
+                cursor.chunk = cursor.next.get();
+                cursor.position = 0;
+                if (cursor.chunk.size() == chunkRows) {
+                    cursor.next = fetch(shard);
+                }
+                return !cursor.chunk.empty();
+            };
+
+            auto greater = [&](size_t a, size_t b) {
+                return less(cursors[b].chunk[cursors[b].position], cursors[a].chunk[cursors[a].position]);
+            };
+            std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+            for (size_t i = 0; i < cursors.size(); ++i) {
+                cursors[i].position = static_cast<size_t>(-1); // advance() moves to the first row
+                if (advance(i)) {
+                    heap.push(i);
+                }
+            }
+
+            while (!heap.empty()) {
+                size_t shard = heap.top();
+                heap.pop();
+                const Row& row = cursors[shard].chunk[cursors[shard].position];
+                if constexpr (std::is_same_v<std::invoke_result_t<Callback&, const Row&>, bool>) {
+                    if (!onRow(row)) {
+                        return;
+                    }
+                } else {
+                    onRow(row);
+                }
+                if (advance(shard)) {
+                    heap.push(shard);
+                }
+            }
+        }
+
+    private:
+        struct Shard {
+            std::unique_ptr<SQLite> db;
+            std::unique_ptr<std::mutex> mutex; // one task per connection at a time
+        };
+
+        std::vector<Shard> shards;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::function<void()>> tasks;
+        bool stopping = false;
+        std::vector<std::thread> threads;
+
+        void post(std::function<void()> task);
+        void work();
+
+        // run function(SQLite&) on the shard's connection on the pool
+        template<typename F>
+        auto run(size_t shard, F function) {
+            using R = std::invoke_result_t<F&, SQLite&>;
+            auto task = std::make_shared<std::packaged_task<R()>>([this, shard, function = std::move(function)]() mutable {
+                std::lock_guard<std::mutex> lock(*shards[shard].mutex);
+                return function(*shards[shard].db);
+            });
+            auto future = task->get_future();
+            post([task] { (*task)(); });
+            return future;
+        }
+
+        template<typename R>
+        static auto collect(std::vector<std::future<R>>& futures) {
+            // wait for all before rethrowing, tasks may reference the caller's stack
+            for (auto& future : futures) {
+                future.wait();
+            }
+            if constexpr (std::is_void_v<R>) {
+                for (auto& future : futures) {
+                    future.get();
+                }
+            } else {
+                std::vector<R> results;
+                results.reserve(futures.size());
+                for (auto& future : futures) {
+                    results.push_back(future.get());
+                }
+                return results;
+            }
+        }
+    };
+
+    // incremental I/O on a single blob value (sqlite3_blob_open), without materializing it
+    class BlobStream {
+    public:
+        BlobStream() {}
+        BlobStream(SQLite& db, const std::string& table, const std::string& column, int64_t rowid, bool writable = false,
+                const std::string& database = "main");
+        ~BlobStream();
+
+        BlobStream(BlobStream&& other) noexcept : db(other.db), blob(other.blob) { other.blob = nullptr; }
+        BlobStream& operator=(BlobStream&& other) noexcept;
+
+        BlobStream(const BlobStream&) = delete;
+        BlobStream& operator=(const BlobStream&) = delete;
+
+        int size() const;
+
+        // read/write size bytes at offset, the blob size cannot be changed (use ZeroBlob to preallocate)
+        void read(void* buffer, int size, int offset) const;
+        void write(const void* data, int size, int offset);
+
+        // move to the same column of another row, cheaper than opening a new stream
+        void reopen(int64_t rowid);
+
+        void close();
+
+        operator bool() const { return blob != nullptr; }
+
+    private:
+        struct sqlite3* db = nullptr;
+        struct sqlite3_blob* blob = nullptr;
+
+        void ensure() const { if (blob == nullptr) throw OtherError("SQLite blob stream not open"); }
+    };
+
+    BlobStream openBlob(const std::string& table, const std::string& column, int64_t rowid, bool writable = false,
+            const std::string& database = "main") { return BlobStream(*this, table, column, rowid, writable, database); }
+
+    enum class FunctionFlags {
+        None = 0,
+        Deterministic = 1 << 0, // same result for the same arguments, usable in indexes and partial index WHERE
+        DirectOnly = 1 << 1, // not callable from triggers, views or schema
+        Innocuous = 1 << 2 // no side effects, callable from schema when trusted_schema is off
+    };
+
+    // application-defined SQL function, argument and result types are deduced from the callable's signature:
+    // arguments as for Statement::get<T>() (int, int64_t, double, std::string, std::string_view, Blob or std::optional
+    // of them, nullopt for NULL), results of the same types or void (NULL); string_view and Blob arguments are only
+    // valid during the call; an exception becomes the SQL error of the statement calling the function
+    template<typename F>
+    void createFunction(const std::string& name, F function, FunctionFlags flags = FunctionFlags::None) {
+        using Arguments = typename FunctionSignature<F>::Arguments;
+        auto* data = new F(std::move(function));
+        registerFunction(name, static_cast<int>(std::tuple_size_v<Arguments>), flags, data,
+                &callScalar<F, Arguments>, nullptr, nullptr, [](void* data) { delete static_cast<F*>(data); });
+    }
+
+    // application-defined aggregate: State is default-constructed per group, step(State&, Args...) is called for each
+    // row and final(State&) returns the result, marshalled as for createFunction()
+    template<typename State, typename Step, typename Final>
+    void createAggregate(const std::string& name, Step step, Final final, FunctionFlags flags = FunctionFlags::None) {
+        static_assert(std::is_default_constructible_v<State>, "aggregate state must be default-constructible");
+        using Arguments = typename DropFirst<typename FunctionSignature<Step>::Arguments>::Type;
+        using Callbacks = std::pair<Step, Final>;
+        auto* data = new Callbacks(std::move(step), std::move(final));
+        registerFunction(name, static_cast<int>(std::tuple_size_v<Arguments>), flags, data,
+                nullptr, &callStep<State, Callbacks, Arguments>, &callFinal<State, Callbacks>,
+                [](void* data) { delete static_cast<Callbacks*>(data); });
+    }
+
+    // how a virtual table column narrows the rows a query visits; text keys compare in BINARY order, so constraints
+    // with another collation (e.g. name = 'a' COLLATE NOCASE) scan and are filtered by SQLite
+    enum class VirtualKey {
+        None, // full scan, SQLite filters
+        Sorted, // the range is sorted ascending by this column: =, <, <=, >, >= are binary searches
+        Lookup // the range is an associative container keyed by this column: = uses equal_range()
+    };
+
+    // column of a virtual table over Element values, see virtualColumn()
+    template<typename Element>
+    struct VirtualColumn {
+        std::string name;
+        DataType type = DataType::Null; // declared type, also which constraint values a key can use
+        VirtualKey key = VirtualKey::None;
+        std::function<void(struct sqlite3_context*, const Element&)> result;
+        std::function<int(const Element&, struct sqlite3_value*)> compare; // element vs a value of matching type
+    };
+
+    // column whose value is get(element) (a callable or member pointer), of the types createFunction() returns
+    template<typename Element, typename Get>
+    static VirtualColumn<Element> virtualColumn(std::string name, Get get, VirtualKey key = VirtualKey::None) {
+        using R = std::decay_t<std::invoke_result_t<Get&, const Element&>>;
+        using T = typename OptionalValue<R>::Type;
+        static_assert(std::is_arithmetic_v<T> || std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view> ||
+                std::is_same_v<T, Blob>, "Unsupported virtual column type");
+        VirtualColumn<Element> column;
+        column.name = std::move(name);
+        column.key = key;
+        if constexpr (std::is_integral_v<T>) {
+            column.type = DataType::Integer;
+        } else if constexpr (std::is_floating_point_v<T>) {
+            column.type = DataType::Float;
+        } else if constexpr (std::is_same_v<T, Blob>) {
+            column.type = DataType::Blob;
+        } else {
+            column.type = DataType::Text;
+        }
+        column.result = [get](struct sqlite3_context* context, const Element& element) {
+            if constexpr (std::is_integral_v<R>) {
+                setResult(context, static_cast<int64_t>(std::invoke(get, element)));
+            } else if constexpr (std::is_floating_point_v<R>) {
+                setResult(context, static_cast<double>(std::invoke(get, element)));
+            } else if constexpr (std::is_same_v<R, std::string>) {
+                setResult(context, std::string_view(std::invoke(get, element)));
+            } else {
+                setResult(context, std::invoke(get, element));
+            }
+        };
+        if (key != VirtualKey::None) {
+            if constexpr (IsOptional<R>::value) {
+                throw OtherError("virtual table key column cannot be optional: " + column.name);
+            } else {
+                column.compare = [get](const Element& element, struct sqlite3_value* value) {
+                    return compareValue(std::invoke(get, element), value);
+                };
+            }
+        }
+        return column;
+    }
+
+    // eponymous read-only virtual table name over range (by reference, must outlive the connection or be
+    // dropped with dropModule()); elements are read live on every query, join and filter it like a table
+    template<typename Range>
+    void createVirtualTable(const std::string& name, const Range& range,
+            std::vector<VirtualColumn<std::decay_t<decltype(*std::begin(range))>>> columns) {
+        registerVirtualTable(name, std::make_unique<RangeTable<Range>>(range, std::move(columns)));
+    }
+
+    void dropModule(const std::string& name); // removes a virtual table of createVirtualTable()
+
+    // online copy of a database between two connections (sqlite3_backup), a few pages per step so the
+    // source stays usable in between; the destination must not be used while the backup is active, run it on
+    // its own thread with connections opened there (or FullMutex) to keep it off the application's handles
+    class Backup {
+    public:
+        Backup(SQLite& destination, SQLite& source, const std::string& destinationName = "main",
+                const std::string& sourceName = "main");
+        ~Backup();
+
+        Backup(Backup&& other) noexcept : destination(other.destination), backup(other.backup) { other.backup = nullptr; }
+        Backup& operator=(Backup&&) = delete;
+
+        Backup(const Backup&) = delete;
+        Backup& operator=(const Backup&) = delete;
+
+        // copy up to pages pages (all if negative), false while pages remain or the source is locked
+        bool step(int pages);
+
+        // copy everything in steps of pagesPerStep, sleeping pause after each step so writers get the lock;
+        // progress(remaining, pageCount) is called after each step and may return false to stop early
+        void run(int pagesPerStep = 100, std::chrono::milliseconds pause = std::chrono::milliseconds(0),
+                const std::function<bool(int remaining, int pageCount)>& progress = {});
+
+        // values as of the last step
+        int remaining() const;
+        int pageCount() const;
+
+        // release the backup, throws the error of the last step; destruction finishes silently
+        void finish();
+
+        operator bool() const { return backup != nullptr; }
+
+    private:
+        struct sqlite3* destination = nullptr;
+        struct sqlite3_backup* backup = nullptr;
+        bool done = false;
+
+        void ensure() const { if (backup == nullptr) throw OtherError("SQLite backup not active"); }
+    };
+
+    Backup backupTo(SQLite& destination, const std::string& destinationName = "main", const std::string& sourceName = "main") {
+        return Backup(destination, *this, destinationName, sourceName);
+    }
+
+    // copy of a database as the bytes of its file (sqlite3_serialize), in-memory databases without extra copy
+    std::vector<std::byte> serialize(const std::string& schema = "main") const;
+
+    // replace schema with a database image (sqlite3_deserialize), held in memory and growable unless readOnly
+    void deserialize(const void* data, size_t size, const std::string& schema = "main", bool readOnly = false);
+    void deserialize(const std::vector<std::byte>& data, const std::string& schema = "main", bool readOnly = false) {
+        deserialize(data.data(), data.size(), schema, readOnly);
+    }
+
+    enum class CheckpointMode {
+        Passive, // copy what readers allow, never waits
+        Full, // wait for writers, then copy everything
+        Restart, // as Full, then wait for readers so the next writer starts the WAL from the beginning
+        Truncate // as Restart, and truncate the WAL file to zero bytes
+    };
+
+    struct CheckpointPolicy {
+        CheckpointMode mode = CheckpointMode::Passive;
+        int walFrames = 1000; // checkpoint once a commit leaves this many frames in the WAL, 0 disables
+        std::chrono::milliseconds interval{0}; // also checkpoint this often while the WAL is not empty, 0 disables
+        std::chrono::milliseconds busyTimeout{1000}; // lock wait of the checkpoint connection (Full, Restart, Truncate)
+        std::string schema = "main";
+    };
+
+    struct CheckpointStats {
+        int walFrames = 0; // WAL frames reported by the most recent commit, 0 once a checkpoint copied all of them
+        int maxWalFrames = 0;
+        uint64_t checkpoints = 0;
+        uint64_t busy = 0; // checkpoints that could not complete because of readers or writers
+        uint64_t failures = 0;
+        uint64_t framesCheckpointed = 0;
+        uint64_t lastMicros = 0; // duration of the most recent checkpoint
+        uint64_t maxMicros = 0;
+        uint64_t totalMicros = 0;
+    };
+
+    // checkpoints a WAL database on its own connection and thread instead of inside the commit that crosses the
+    // auto-checkpoint size; attached to the writer through sqlite3_wal_hook, which replaces (disables) its
+    // auto-checkpoint until destruction restores it; destroy before closing the writer, not while it is in use
+    class CheckpointScheduler {
+    public:
+        explicit CheckpointScheduler(SQLite& writer);
+        CheckpointScheduler(SQLite& writer, const CheckpointPolicy& policy);
+        ~CheckpointScheduler();
+
+        CheckpointScheduler(const CheckpointScheduler&) = delete;
+        CheckpointScheduler& operator=(const CheckpointScheduler&) = delete;
+
+        void requestCheckpoint(); // run one on the scheduler thread soon, regardless of the triggers
+
+        CheckpointStats stats() const;
+
+    private:
+        static int walHook(void* context, struct sqlite3* db, const char* schema, int frames);
+        void work();
+        void checkpoint();
+
+        struct sqlite3* writer;
+        CheckpointPolicy policy;
+        int autocheckpoint; // writer's wal_autocheckpoint, restored on destruction
+        std::atomic<int> lastCheckpointed{0}; // frames of the WAL copied as of the previous checkpoint
+        std::unique_ptr<SQLite> connection;
+
+        std::atomic<int> walFrames{0};
+        std::atomic<int> maxWalFrames{0};
+        std::atomic<uint64_t> checkpoints{0};
+        std::atomic<uint64_t> busy{0};
+        std::atomic<uint64_t> failures{0};
+        std::atomic<uint64_t> framesCheckpointed{0};
+        std::atomic<uint64_t> lastMicros{0};
+        std::atomic<uint64_t> maxMicros{0};
+        std::atomic<uint64_t> totalMicros{0};
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool requested = false;
+        bool stopping = false;
+        std::thread worker;
+    };
+
+#if defined(SQLITE_ENABLE_SESSION)
+    // records changes to attached tables (sqlite3session, needs SQLITE_ENABLE_SESSION and SQLITE_ENABLE_PREUPDATE_HOOK)
+    // as binary changesets or patchsets to apply elsewhere; tables need a PRIMARY KEY, destroy before closing db
+    class Session {
+    public:
+        explicit Session(SQLite& db, const std::string& schema = "main");
+        ~Session();
+
+        Session(Session&& other) noexcept : session(other.session) { other.session = nullptr; }
+        Session& operator=(Session&&) = delete;
+
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+
+        void attach(const std::string& table);
+        void attachAll(); // every table, including ones created later
+
+        void setEnabled(bool enabled);
+        bool isEnabled() const;
+        bool isEmpty() const; // no changes recorded
+
+        // changes since the session was created, with the old values of updated and deleted rows
+        std::vector<std::byte> changeset() const;
+        // smaller form without old values except primary keys, conflicts are detected less precisely
+        std::vector<std::byte> patchset() const;
+
+        // same, streamed to output(data, size) in pieces instead of built in memory
+        void changeset(const std::function<void(const void* data, size_t size)>& output) const;
+        void patchset(const std::function<void(const void* data, size_t size)>& output) const;
+
+    private:
+        struct sqlite3_session* session = nullptr;
+    };
+
+    enum class ChangesetConflict {
+        Data, // row found, but its current values differ from the expected old values
+        NotFound, // row to update or delete does not exist
+        Conflict, // row to insert exists (primary key)
+        Constraint, // other constraint violation
+        ForeignKey // foreign key violations remain after applying
+    };
+
+    enum class ConflictAction {
+        Omit, // skip the change
+        Replace, // apply it anyway, for Data and Conflict only
+        Abort // roll back everything applied, applyChangeset() throws
+    };
+
+    // apply a changeset or patchset in one transaction, onConflict(conflict, table) decides each conflict
+    // (without one every conflicting change is omitted)
+    void applyChangeset(const std::vector<std::byte>& changeset,
+            const std::function<ConflictAction(ChangesetConflict conflict, std::string_view table)>& onConflict = {});
+
+    // changeset that undoes changeset
+    static std::vector<std::byte> invertChangeset(const std::vector<std::byte>& changeset);
+#endif // SQLITE_ENABLE_SESSION
+
+    int64_t lastInsertRowid() const;
 
     void exec(const std::string& sql);
     void execute(const std::string& sql) { exec(sql); }
 
+    int changes() const; // rows changed by the most recent INSERT, UPDATE or DELETE
+
     operator bool() const { return db != nullptr; }
 
+    // underlying connection for sqlite3_* calls the wrapper does not cover (or as a baseline), still owned here
+    struct sqlite3* handle() const { return db; }
+
 private:
     struct sqlite3* db = nullptr;
 
+    std::unique_ptr<StatementCache> statementCache_;
+
+    int savepointDepth = 0; // savepoints with generated names
+
+    struct BusyHandler {
+        BusyPolicy policy;
+        uint32_t random = 0; // jitter generator state
+
+        std::chrono::steady_clock::time_point eventStart; // start of the current lock conflict
+        size_t eventBucket = 0; // histogram bucket the current conflict is counted in
+
+        // read by busyStats() from any thread
+        std::atomic<uint64_t> events{0};
+        std::atomic<uint64_t> retries{0};
+        std::atomic<uint64_t> timeouts{0};
+        std::atomic<uint64_t> waitMicros{0};
+        std::array<std::atomic<uint64_t>, BusyStats::bucketBounds.size() + 1> histogram{};
+    };
+
+    std::unique_ptr<BusyHandler> busyHandler;
+
+    struct Profiler {
+        ProfilerOptions options;
+
+        mutable std::mutex mutex; // guards profiles, for snapshots from other threads
+        std::unordered_map<std::string_view, std::unique_ptr<QueryProfile>> profiles; // keys point into QueryProfile::sql
+        std::unordered_map<struct sqlite3_stmt*, uint64_t> runningRows; // rows of runs in progress (countRows)
+    };
+
+    std::unique_ptr<Profiler> profiler;
+
+    std::shared_ptr<const PlanGuard> planGuard; // shared with the statement cache's prepare check
+
+#if defined(SQLITE_ENABLE_SNAPSHOT)
+    void openSnapshot(const Snapshot& snapshot, const std::string& schema); // in a transaction that has not read yet
+#endif
+
+    static void checkPlan(const PlanGuard& guard, const Statement& statement);
+    void installPlanGuard();
+
+    struct Progress {
+        int interval = 1000;
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); // of Deadline scopes
+        std::function<bool()> handler;
+        std::shared_ptr<CancellationToken::State> token;
+    };
+
+    std::unique_ptr<Progress> progress;
+
+    Progress& progressState();
+    void setTokenConnection(struct sqlite3* connection); // the connection a CancellationToken interrupts, may be nullptr
+    static int progressCallback(void* context);
+
+    static int traceCallback(unsigned type, void* context, void* p, void* x);
+    void installTrace();
+
+    static int busyCallback(void* context, int count);
+
+    template<typename T> struct IsOptional : std::false_type {};
+    template<typename T> struct IsOptional<std::optional<T>> : std::true_type {};
+
+    // callable signature, arguments decayed to value types
+    template<typename F> struct FunctionSignature : FunctionSignature<decltype(&F::operator())> {};
+    template<typename R, typename... Args> struct FunctionSignature<R(*)(Args...)> {
+        using Result = R;
+        using Arguments = std::tuple<std::decay_t<Args>...>;
+    };
+    template<typename R, typename... Args> struct FunctionSignature<R(Args...)> : FunctionSignature<R(*)(Args...)> {};
+    template<typename C, typename R, typename... Args> struct FunctionSignature<R(C::*)(Args...)> : FunctionSignature<R(*)(Args...)> {};
+    template<typename C, typename R, typename... Args> struct FunctionSignature<R(C::*)(Args...) const> : FunctionSignature<R(*)(Args...)> {};
+
+    template<typename Tuple> struct DropFirst;
+    template<typename T, typename... Ts> struct DropFirst<std::tuple<T, Ts...>> { using Type = std::tuple<Ts...>; };
+
+    using FunctionCallback = void (*)(struct sqlite3_context*, int, struct sqlite3_value**);
+    using FinalCallback = void (*)(struct sqlite3_context*);
+
+    // sqlite3_create_function_v2(), destroy(data) is called when the function is replaced, the connection closes or this fails
+    void registerFunction(const std::string& name, int argumentCount, FunctionFlags flags, void* data,
+            FunctionCallback function, FunctionCallback step, FinalCallback final, void (*destroy)(void*));
+
+    static void* functionData(struct sqlite3_context* context);
+    static void** aggregateState(struct sqlite3_context* context, bool create); // slot for a State*, nullptr if none
+    static void setErrorResult(struct sqlite3_context* context, const char* message);
+    static void setNoMemoryResult(struct sqlite3_context* context);
+
+    // argument values, types other than std::optional are specialized below the class
+    template<typename T> static T argumentValue(struct sqlite3_value* value);
+    static bool isNullValue(struct sqlite3_value* value);
+
+    template<typename T>
+    static T argument(struct sqlite3_value* value) {
+        if constexpr (IsOptional<T>::value) {
+            return isNullValue(value) ? T() : T(argument<typename T::value_type>(value));
+        } else {
+            static_assert(std::is_same_v<T, int> ||
+                          std::is_same_v<T, int64_t> ||
+                          std::is_same_v<T, double> ||
+                          std::is_same_v<T, std::string> ||
+                          std::is_same_v<T, std::string_view> ||
+                          std::is_same_v<T, Blob>, "Unsupported argument type");
+            return argumentValue<T>(value);
+        }
+    }
+
+    template<typename T> struct OptionalValue { using Type = T; };
+    template<typename T> struct OptionalValue<std::optional<T>> { using Type = T; };
+
+    static DataType valueType(struct sqlite3_value* value);
+
+    // order of a key column value against a constraint value of the same type class
+    template<typename T>
+    static int compareValue(const T& element, struct sqlite3_value* value) {
+        if constexpr (std::is_integral_v<T>) {
+            if (valueType(value) == DataType::Integer) {
+                int64_t other = argumentValue<int64_t>(value);
+                return static_cast<int64_t>(element) < other ? -1 : (static_cast<int64_t>(element) > other ? 1 : 0);
+            }
+            double other = argumentValue<double>(value);
+            return static_cast<double>(element) < other ? -1 : (static_cast<double>(element) > other ? 1 : 0);
+        } else if constexpr (std::is_floating_point_v<T>) {
+            double other = argumentValue<double>(value);
+            return element < other ? -1 : (element > other ? 1 : 0);
+        } else if constexpr (std::is_same_v<T, Blob>) {
+            Blob other = argumentValue<Blob>(value);
+            int common = std::min(element.size, other.size);
+            int order = common > 0 ? std::memcmp(element.data, other.data, common) : 0;
+            return order != 0 ? order : (element.size < other.size ? -1 : (element.size > other.size ? 1 : 0));
+        } else {
+            return std::string_view(element).compare(argumentValue<std::string_view>(value)); // BINARY collation
+        }
+    }
+
+    // type-erased virtual table source, the sqlite3_module callbacks in sqlite.cpp use only this
+    class VirtualCursor {
+    public:
+        virtual ~VirtualCursor() = default;
+        // restrict to rows of column (-1 for all) matching the constraints described by operators (see bestIndex)
+        virtual void filter(int column, const char* operators, struct sqlite3_value** values) = 0;
+        virtual bool eof() const = 0;
+        virtual void next() = 0;
+        virtual void result(int column, struct sqlite3_context* context) const = 0;
+        virtual int64_t rowid() const = 0;
+    };
+
+    class VirtualTableSource {
+    public:
+        struct ColumnInfo {
+            std::string name;
+            DataType type;
+            VirtualKey key;
+        };
+
+        virtual ~VirtualTableSource() = default;
+        virtual std::unique_ptr<VirtualCursor> open() const = 0;
+        virtual double estimatedRows() const = 0;
+        std::vector<ColumnInfo> columns;
+    };
+
+    template<typename T, typename = void> struct HasEqualRange : std::false_type {};
+    template<typename T> struct HasEqualRange<T, std::void_t<typename T::key_type,
+            decltype(std::declval<const T&>().equal_range(std::declval<const typename T::key_type&>()))>> : std::true_type {};
+
+    template<typename T, typename = void> struct HasSize : std::false_type {};
+    template<typename T> struct HasSize<T, std::void_t<decltype(std::size(std::declval<const T&>()))>> : std::true_type {};
+
+    template<typename Range>
+    class RangeTable : public VirtualTableSource {
+    public:
+        using Element = std::decay_t<decltype(*std::begin(std::declval<const Range&>()))>;
+        using Iterator = decltype(std::begin(std::declval<const Range&>()));
+
+        RangeTable(const Range& range, std::vector<VirtualColumn<Element>> definitions)
+                : range(range), definitions(std::move(definitions)) {
+            for (auto& column : this->definitions) {
+                if (column.key == VirtualKey::Lookup && !HasEqualRange<Range>::value) {
+                    column.key = VirtualKey::None; // no equal_range() to look up with
+                }
+                columns.push_back(ColumnInfo{column.name, column.type, column.key});
+            }
+        }
+
+        std::unique_ptr<VirtualCursor> open() const override { return std::make_unique<Cursor>(*this); }
+
+        double estimatedRows() const override {
+            if constexpr (HasSize<Range>::value) {
+                return static_cast<double>(std::size(range));
+            } else {
+                return 1e6;
+            }
+        }
+
+    private:
+        const Range& range;
+        std::vector<VirtualColumn<Element>> definitions;
+
+        class Cursor : public VirtualCursor {
+        public:
+            explicit Cursor(const RangeTable& table) : table(table), current(std::begin(table.range)), end(std::end(table.range)) {}
+
+            void filter(int column, const char* operators, struct sqlite3_value** values) override {
+                current = std::begin(table.range);
+                end = std::end(table.range);
+                if (column < 0) {
+                    return;
+                }
+                const VirtualColumn<Element>& definition = table.definitions[column];
+                for (int i = 0; operators[i]; ++i) {
+                    struct sqlite3_value* value = values[i];
+                    DataType type = valueType(value);
+                    if (type == DataType::Null) {
+                        current = end; // comparisons with NULL are never true
+                        return;
+                    }
+                    bool numeric = definition.type == DataType::Integer || definition.type == DataType::Float;
+                    if (numeric ? type != DataType::Integer && type != DataType::Float : type != definition.type) {
+                        continue; // other type class, affinity rules apply, leave it to SQLite
+                    }
+                    if (definition.key == VirtualKey::Lookup) {
+                        lookup(value);
+                        continue;
+                    }
+                    auto less = [&definition, value](const Element& element) { return definition.compare(element, value) < 0; };
+                    auto lessEqual = [&definition, value](const Element& element) { return definition.compare(element, value) <= 0; };
+                    switch (operators[i]) {
+                        case 'e': // =
+                            current = std::partition_point(current, end, less);
+                            end = std::partition_point(current, end, lessEqual);
+                            break;
+                        case 'g': // >
+                            current = std::partition_point(current, end, lessEqual);
+                            break;
+                        case 'G': // >=
+                            current = std::partition_point(current, end, less);
+                            break;
+                        case 'l': // <
+                            end = std::partition_point(current, end, less);
+                            break;
+                        case 'L': // <=
+                            end = std::partition_point(current, end, lessEqual);
+                            break;
+                    }
+                }
+            }
+
+            bool eof() const override { return current == end; }
+            void next() override { ++current; }
+            void result(int column, struct sqlite3_context* context) const override { table.definitions[column].result(context, *current); }
+            int64_t rowid() const override { return static_cast<int64_t>(std::distance(std::begin(table.range), current)); }
+
+        private:
+            const RangeTable& table;
+            Iterator current;
+            Iterator end;
+
+            void lookup(struct sqlite3_value* value) {
+                if constexpr (HasEqualRange<Range>::value) {
+                    using Key = typename Range::key_type;
+                    if constexpr (std::is_arithmetic_v<Key> || std::is_same_v<Key, std::string> || std::is_same_v<Key, std::string_view>) {
+                        Key key;
+                        if constexpr (std::is_integral_v<Key>) {
+                            key = static_cast<Key>(argumentValue<int64_t>(value));
+                        } else if constexpr (std::is_floating_point_v<Key>) {
+                            key = static_cast<Key>(argumentValue<double>(value));
+                        } else {
+                            key = Key(argumentValue<std::string_view>(value));
+                        }
+                        auto matches = table.range.equal_range(key);
+                        current = matches.first;
+                        end = matches.second;
+                    }
+                }
+            }
+        };
+    };
+
+    struct VirtualModule; // sqlite3_module callbacks
+    void registerVirtualTable(const std::string& name, std::unique_ptr<VirtualTableSource> source);
+
+    static void setResult(struct sqlite3_context* context, std::nullptr_t);
+    static void setResult(struct sqlite3_context* context, int value);
+    static void setResult(struct sqlite3_context* context, int64_t value);
+    static void setResult(struct sqlite3_context* context, double value);
+    static void setResult(struct sqlite3_context* context, std::string_view value); // copied
+    static void setResult(struct sqlite3_context* context, const Blob& value); // copied
+
+    template<typename T>
+    static void setResult(struct sqlite3_context* context, const std::optional<T>& value) {
+        if (value) {
+            setResult(context, *value);
+        } else {
+            setResult(context, nullptr);
+        }
+    }
+
+    // invoke function with the call's arguments and store its result, exceptions become the SQL error
+    template<typename F, typename... Args, size_t... I>
+    static void invokeFunction(struct sqlite3_context* context, struct sqlite3_value** values, F&& function,
+            std::tuple<Args...>*, std::index_sequence<I...>) {
+        try {
+            using R = std::invoke_result_t<F, Args...>;
+            if constexpr (std::is_void_v<R>) {
+                function(argument<Args>(values[I])...);
+                setResult(context, nullptr);
+            } else {
+                setResult(context, function(argument<Args>(values[I])...));
+            }
+        } catch (const std::bad_alloc&) {
+            setNoMemoryResult(context);
+        } catch (const std::exception& e) {
+            setErrorResult(context, e.what());
+        } catch (...) {
+            setErrorResult(context, "unknown exception in SQL function");
+        }
+    }
+
+    template<typename F, typename Arguments>
+    static void callScalar(struct sqlite3_context* context, int, struct sqlite3_value** values) {
+        F& function = *static_cast<F*>(functionData(context));
+        invokeFunction(context, values, function, static_cast<Arguments*>(nullptr),
+                std::make_index_sequence<std::tuple_size_v<Arguments>>());
+    }
+
+    template<typename State, typename Callbacks, typename Arguments>
+    static void callStep(struct sqlite3_context* context, int, struct sqlite3_value** values) {
+        void** slot = aggregateState(context, true);
+        if (!slot) {
+            setNoMemoryResult(context);
+            return;
+        }
+        State* state = static_cast<State*>(*slot);
+        if (!state) {
+            try {
+                *slot = state = new State();
+            } catch (...) {
+                setErrorResult(context, "failed to create aggregate state");
+                return;
+            }
+        }
+        auto& step = static_cast<Callbacks*>(functionData(context))->first;
+        auto bound = [&step, state](auto&&... args) { step(*state, std::forward<decltype(args)>(args)...); };
+        invokeFunction(context, values, bound, static_cast<Arguments*>(nullptr),
+                std::make_index_sequence<std::tuple_size_v<Arguments>>());
+    }
+
+    // also called for cleanup when the statement stops early, so the state is always released here
+    template<typename State, typename Callbacks>
+    static void callFinal(struct sqlite3_context* context) {
+        void** slot = aggregateState(context, false);
+        std::unique_ptr<State> state(slot ? static_cast<State*>(*slot) : nullptr);
+        auto& final = static_cast<Callbacks*>(functionData(context))->second;
+        invokeFunction(context, nullptr, [&final, &state]() {
+            if (!state) {
+                state = std::make_unique<State>(); // no rows in the group
+            }
+            return final(*state);
+        }, static_cast<std::tuple<>*>(nullptr), std::index_sequence<>());
+    }
+
+    bool isAutocommit() const;
+
     static int toSQLiteOpenFlags(OpenFlags flags);
 
+    void applyOptions(const OpenOptions& options);
+    int64_t pragmaInt(const char* name) const;
+
     void ensure() const { if (db == nullptr) throw OtherError("SQLite database connection not initialized"); }
 };
 
@@ -295,9 +2599,38 @@ inline bool operator&(SQLite::OpenFlags lhs, SQLite::OpenFlags rhs) {
     return static_cast<bool>(static_cast<T>(lhs) & static_cast<T>(rhs));
 }
 
+// overload bitwise OR operator for FunctionFlags
+inline SQLite::FunctionFlags operator|(SQLite::FunctionFlags lhs, SQLite::FunctionFlags rhs) {
+    using T = std::underlying_type_t<SQLite::FunctionFlags>;
+    return static_cast<SQLite::FunctionFlags>(static_cast<T>(lhs) | static_cast<T>(rhs));
+}
+
+// overload bitwise AND operator for FunctionFlags
+inline bool operator&(SQLite::FunctionFlags lhs, SQLite::FunctionFlags rhs) {
+    using T = std::underlying_type_t<SQLite::FunctionFlags>;
+    return static_cast<bool>(static_cast<T>(lhs) & static_cast<T>(rhs));
+}
+
 std::string to_string(SQLite::DataType type);
 
 
+// specializations for the template SQLite::Statement::columnValue() function, defined in sqlite.cpp
+template<> int SQLite::Statement::columnValue<int>(int index) const;
+template<> int64_t SQLite::Statement::columnValue<int64_t>(int index) const;
+template<> double SQLite::Statement::columnValue<double>(int index) const;
+template<> std::string SQLite::Statement::columnValue<std::string>(int index) const;
+template<> std::string_view SQLite::Statement::columnValue<std::string_view>(int index) const;
+template<> SQLite::Blob SQLite::Statement::columnValue<SQLite::Blob>(int index) const;
+
+// specializations for the template SQLite::argumentValue() function, defined in sqlite.cpp
+template<> int SQLite::argumentValue<int>(struct sqlite3_value* value);
+template<> int64_t SQLite::argumentValue<int64_t>(struct sqlite3_value* value);
+template<> double SQLite::argumentValue<double>(struct sqlite3_value* value);
+template<> std::string SQLite::argumentValue<std::string>(struct sqlite3_value* value);
+template<> std::string_view SQLite::argumentValue<std::string_view>(struct sqlite3_value* value);
+template<> SQLite::Blob SQLite::argumentValue<SQLite::Blob>(struct sqlite3_value* value);
+
+
 // specializations for the template SQLite::Column::get() function
 template<> inline int SQLite::Column::get<int>() const {
     return statement.getInt(index);
@@ -315,6 +2648,10 @@ template<> inline std::string SQLite::Column::get<std::string>() const {
     return statement.getString(index);
 }
 
+template<> inline std::string_view SQLite::Column::get<std::string_view>() const {
+    return statement.getStringView(index);
+}
+
 template<> inline SQLite::Blob SQLite::Column::get<SQLite::Blob>() const {
     return statement.getBlob(index);
 }
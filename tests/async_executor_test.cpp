@@ -0,0 +1,99 @@
+// regression tests for SQLite::AsyncExecutor, exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+template<typename T>
+static std::string errorOf(std::future<T>& future) {
+    try {
+        future.get();
+    } catch (const std::exception& e) {
+        return e.what();
+    }
+    return "";
+}
+
+static SQLite::AsyncExecutor makeExecutor() {
+    SQLite db(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+    db.exec("INSERT INTO t VALUES(3, 'existing')");
+    return SQLite::AsyncExecutor(std::move(db));
+}
+
+// a grouped write that rolls back the whole transaction must not make the group commit nothing but report
+// "no transaction is active": earlier writes fail with its error, later ones run normally
+static void testWriteGroupRolledBackByStatement() {
+    auto executor = makeExecutor();
+    std::promise<void> release;
+    auto blocker = executor.submit([gate = release.get_future().share()](SQLite&) { gate.wait(); }); // queue up a group
+    auto first = executor.execute("INSERT INTO t VALUES(1, 'a')");
+    auto second = executor.execute("INSERT INTO t VALUES(2, 'b')");
+    auto third = executor.execute("INSERT OR ROLLBACK INTO t VALUES(3, 'c')");
+    auto fourth = executor.execute("INSERT INTO t VALUES(4, 'd')");
+    release.set_value();
+    blocker.get();
+
+    std::string error = errorOf(third);
+    CHECK(error.find("UNIQUE constraint failed") != std::string::npos);
+    CHECK(errorOf(first) == error);
+    CHECK(errorOf(second) == error);
+    CHECK(fourth.get() == 1);
+
+    auto rows = executor.query<int64_t>("SELECT id FROM t ORDER BY id").get();
+    CHECK(rows.size() == 2);
+    CHECK(std::get<0>(rows[0]) == 3);
+    CHECK(std::get<0>(rows[1]) == 4);
+}
+
+// a failing write in a group only undoes itself
+static void testWriteGroupFailedStatement() {
+    auto executor = makeExecutor();
+    std::promise<void> release;
+    auto blocker = executor.submit([gate = release.get_future().share()](SQLite&) { gate.wait(); });
+    auto first = executor.execute("INSERT INTO t VALUES(1, 'a')");
+    auto second = executor.execute("INSERT INTO t VALUES(3, 'duplicate')");
+    auto third = executor.execute("INSERT INTO t VALUES(4, 'd')");
+    release.set_value();
+    blocker.get();
+
+    CHECK(first.get() == 1);
+    CHECK(errorOf(second).find("UNIQUE constraint failed") != std::string::npos);
+    CHECK(third.get() == 1);
+    CHECK(executor.query<int64_t>("SELECT count(*) FROM t").get().size() == 1);
+    CHECK(std::get<0>(executor.query<int64_t>("SELECT count(*) FROM t").get()[0]) == 3);
+}
+
+// views and C strings are copied into the task
+static void testExecuteCopiesViews() {
+    auto executor = makeExecutor();
+    std::future<int> inserted;
+    {
+        std::string name = "view";
+        inserted = executor.execute("INSERT INTO t VALUES(?, ?)", 10, std::string_view(name));
+    }
+    CHECK(inserted.get() == 1);
+    CHECK(executor.execute("INSERT INTO t VALUES(?, ?)", 11, "literal").get() == 1);
+    auto rows = executor.query<std::string>("SELECT name FROM t WHERE id >= 10 ORDER BY id").get();
+    CHECK(rows.size() == 2);
+    CHECK(std::get<0>(rows[0]) == "view");
+    CHECK(std::get<0>(rows[1]) == "literal");
+}
+
+int main() {
+    testWriteGroupRolledBackByStatement();
+    testWriteGroupFailedStatement();
+    testExecuteCopiesViews();
+    std::puts("async_executor_test passed");
+    return 0;
+}
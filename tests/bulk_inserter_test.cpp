@@ -0,0 +1,125 @@
+// tests for SQLite::BulkInserter, exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+static SQLite openMemory() {
+    return SQLite(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+}
+
+static int64_t count(SQLite& db, const std::string& sql) {
+    auto statement = db.prepare(sql);
+    CHECK(statement.step());
+    return statement.getInt64(0);
+}
+
+// 7 rows through 3-row statements in 5-row transactions: the transaction limit and finish() step partial batches
+static void testMultiRowPartialBatch() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+    SQLite::BulkInsertOptions options;
+    options.rowsPerStatement = 3;
+    options.rowsPerTransaction = 5;
+    SQLite::BulkInserter inserter(db, "t", {"id", "name"}, options);
+    for (int i = 1; i <= 7; ++i) {
+        inserter.insert(i, "row " + std::to_string(i));
+    }
+    CHECK(inserter.pending() == 2);
+    inserter.finish();
+    CHECK(inserter.pending() == 0);
+
+    auto stats = inserter.stats();
+    CHECK(stats.rows == 7);
+    CHECK(stats.steps == 3); // rows 1-3, 4-5 at the transaction limit, 6-7 by finish()
+    CHECK(stats.transactions == 2);
+    CHECK(count(db, "SELECT count(*) FROM t") == 7);
+    CHECK(count(db, "SELECT sum(id) FROM t WHERE name = 'row ' || id") == 28);
+    CHECK(!db.inTransaction());
+}
+
+// tuples and projected structs insert like separate values
+static void testInsertAll() {
+    struct Item {
+        int id;
+        std::string name;
+    };
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+    SQLite::BulkInserter inserter(db, "t", {"id", "name"});
+    std::vector<std::tuple<int, std::string>> tuples = {{1, "a"}, {2, "b"}};
+    std::vector<Item> items = {{3, "c"}, {4, "d"}};
+    inserter.insertAll(tuples);
+    inserter.insertAll(items, [](const Item& item) { return std::tie(item.id, item.name); });
+    inserter.finish();
+    CHECK(inserter.stats().rows == 4);
+    CHECK(count(db, "SELECT count(*) FROM t") == 4);
+}
+
+// a constraint violation drops that row only, the same inserter and transaction insert the following ones
+static void testRecoverAfterFailedRow() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT UNIQUE)");
+    SQLite::BulkInserter inserter(db, "t", {"id", "name"});
+    inserter.insert(1, "a");
+    bool failed = false;
+    try {
+        inserter.insert(2, "a");
+    } catch (const SQLite::Error& e) {
+        failed = true;
+        CHECK(std::string(e.what()).find("UNIQUE") != std::string::npos);
+    }
+    CHECK(failed);
+    CHECK(inserter.stats().rows == 1);
+    inserter.insert(3, "b");
+    inserter.finish();
+    CHECK(inserter.stats().rows == 2);
+    CHECK(count(db, "SELECT count(*) FROM t") == 2);
+    CHECK(count(db, "SELECT count(*) FROM t WHERE id = 2") == 0);
+}
+
+// with multi-row statements the whole failed batch is dropped
+static void testRecoverAfterFailedBatch() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT UNIQUE)");
+    SQLite::BulkInsertOptions options;
+    options.rowsPerStatement = 2;
+    SQLite::BulkInserter inserter(db, "t", {"id", "name"}, options);
+    inserter.insert(1, "a");
+    inserter.insert(2, "b");
+    inserter.insert(3, "c");
+    bool failed = false;
+    try {
+        inserter.insert(4, "a");
+    } catch (const SQLite::Error&) {
+        failed = true;
+    }
+    CHECK(failed);
+    CHECK(inserter.pending() == 0);
+    inserter.insert(5, "e");
+    inserter.finish();
+    CHECK(inserter.stats().rows == 3);
+    CHECK(count(db, "SELECT count(*) FROM t") == 3);
+    CHECK(count(db, "SELECT sum(id) FROM t") == 8);
+}
+
+int main() {
+    testMultiRowPartialBatch();
+    testInsertAll();
+    testRecoverAfterFailedRow();
+    testRecoverAfterFailedBatch();
+    std::puts("bulk_inserter_test passed");
+    return 0;
+}
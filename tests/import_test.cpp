@@ -0,0 +1,108 @@
+// regression tests for SQLite::importCsv, exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+static std::string tempPath(const std::string& name) {
+    return "/tmp/sqlite_import_test_" + std::to_string(getpid()) + "_" + name;
+}
+
+static void writeFile(const std::string& path, const std::string& content) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    CHECK(file);
+    CHECK(std::fwrite(content.data(), 1, content.size(), file) == content.size());
+    std::fclose(file);
+}
+
+// text is bound from the mapping without copies, including rows pending in a multi-row statement
+static void testImportMultiRow() {
+    std::string csv = tempPath("rows.csv");
+    writeFile(csv, "id,name\n1,one\n2,\"t\"\"wo\"\n3,three\n4,four\n5,five\n");
+    SQLite db(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+    SQLite::BulkInsertOptions options;
+    options.rowsPerStatement = 2;
+    CHECK(db.importCsv(csv, "t", SQLite::CsvOptions(), options).rows == 5);
+    auto statement = db.prepare("SELECT group_concat(name, '|') FROM (SELECT name FROM t ORDER BY id)");
+    CHECK(statement.step());
+    CHECK(statement.getString(0) == "one|t\"wo|three|four|five");
+    std::remove(csv.c_str());
+}
+
+// a constraint error in a multi-row batch names the lines of the batch
+static void testImportErrorLines() {
+    std::string csv = tempPath("duplicate.csv");
+    writeFile(csv, "id,name\n1,one\n2,two\n3,three\n2,again\n5,five\n");
+    SQLite db(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+    SQLite::BulkInsertOptions options;
+    options.rowsPerStatement = 2;
+    std::string message;
+    try {
+        db.importCsv(csv, "t", SQLite::CsvOptions(), options);
+    } catch (const SQLite::Error& e) {
+        message = e.what();
+    }
+    CHECK(message.find("lines 4-5: ") == 0);
+    CHECK(message.find("UNIQUE constraint failed") != std::string::npos);
+    std::remove(csv.c_str());
+}
+
+// BusyError keeps its type so callers can retry
+static void testImportKeepsErrorType() {
+    std::string csv = tempPath("busy.csv");
+    std::string database = tempPath("busy.db");
+    writeFile(csv, "id,name\n1,one\n");
+    SQLite db(database, SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create);
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+    SQLite other(database, SQLite::OpenFlags::ReadWrite);
+    other.exec("BEGIN IMMEDIATE");
+    bool busy = false;
+    try {
+        db.importCsv(csv, "t");
+    } catch (const SQLite::BusyError& e) {
+        busy = std::string(e.what()).find("line 2: ") == 0;
+    }
+    CHECK(busy);
+    other.exec("ROLLBACK");
+    std::remove(csv.c_str());
+    std::remove(database.c_str());
+}
+
+// the table name is quoted like the column names, with and without a header
+static void testImportQuotesTableName() {
+    std::string csv = tempPath("quoted.csv");
+    writeFile(csv, "1,one\n2,two\n");
+    SQLite db(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+    db.exec("CREATE TABLE \"order items\"(id INTEGER PRIMARY KEY, name TEXT)");
+    SQLite::CsvOptions options;
+    options.header = false;
+    CHECK(db.importCsv(csv, "order items", options).rows == 2);
+    writeFile(csv, "id,name\n3,three\n");
+    CHECK(db.importCsv(csv, "order items").rows == 1);
+    auto statement = db.prepare("SELECT count(*) FROM \"order items\"");
+    CHECK(statement.step());
+    CHECK(statement.getInt64(0) == 3);
+    std::remove(csv.c_str());
+}
+
+int main() {
+    testImportMultiRow();
+    testImportErrorLines();
+    testImportKeepsErrorType();
+    testImportQuotesTableName();
+    std::puts("import_test passed");
+    return 0;
+}
@@ -0,0 +1,54 @@
+// regression tests for interrupts and cancellation, exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+static const char* endless = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) SELECT count(*) FROM c";
+
+// an open() whose options fail must not leave a token pointing at the closed handle
+static void testTokenAfterFailedOpen() {
+    SQLite db;
+    auto token = db.cancellationToken();
+    SQLite::OpenOptions options;
+    options.journalMode = SQLite::JournalMode::WAL; // not possible for an in-memory database
+    bool failed = false;
+    try {
+        db.open(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory, options);
+    } catch (const std::exception&) {
+        failed = true;
+    }
+    CHECK(failed);
+    token.cancel(); // must not touch the freed handle
+    token.reset();
+}
+
+static void testDeadlineInterrupts() {
+    SQLite db(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+    bool interrupted = false;
+    try {
+        auto deadline = db.withTimeout(std::chrono::milliseconds(20));
+        db.exec(endless);
+    } catch (const SQLite::InterruptedError&) {
+        interrupted = true;
+    }
+    CHECK(interrupted);
+    db.exec("SELECT 1");
+}
+
+int main() {
+    testTokenAfterFailedOpen();
+    testDeadlineInterrupts();
+    std::puts("interrupt_test passed");
+    return 0;
+}
@@ -0,0 +1,105 @@
+// tests for SQLite::enableProfiling, exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+static SQLite openMemory() {
+    return SQLite(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+}
+
+static const SQLite::QueryProfile* find(const std::vector<SQLite::QueryProfile>& profiles, const std::string& sql) {
+    for (const auto& profile : profiles) {
+        if (profile.sql == sql) {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+// calls, rows and the statement status counters are summed per SQL text
+static void testCounters() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(x INTEGER, y TEXT)");
+    db.exec("INSERT INTO t VALUES (3, 'c'), (1, 'a'), (2, 'b')");
+    SQLite::ProfilerOptions options;
+    options.countRows = true;
+    db.enableProfiling(options);
+
+    const std::string sql = "SELECT x FROM t ORDER BY y";
+    auto statement = db.prepare(sql);
+    for (int run = 0; run < 2; ++run) {
+        int rows = 0;
+        while (statement.step()) {
+            ++rows;
+        }
+        CHECK(rows == 3);
+        statement.reset();
+    }
+
+    auto profiles = db.profileSnapshot();
+    const SQLite::QueryProfile* profile = find(profiles, sql);
+    CHECK(profile);
+    CHECK(profile->calls == 2);
+    CHECK(profile->rows == 6);
+    CHECK(profile->fullScanSteps >= 4); // full scan of t, counted per run after the reset
+    CHECK(profile->sorts == 2);
+    CHECK(profile->vmSteps > 0);
+    uint64_t histogramCalls = 0;
+    for (uint64_t calls : profile->histogram) {
+        histogramCalls += calls;
+    }
+    CHECK(histogramCalls == 2);
+
+    db.resetProfiles();
+    CHECK(find(db.profileSnapshot(), sql) == nullptr);
+    db.disableProfiling();
+    db.exec(sql);
+    CHECK(db.profileSnapshot().empty());
+}
+
+// the slow query callback sees the expanded SQL; an exception it throws does not reach the statement
+static void testSlowQueryCallback() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(x INTEGER)");
+    std::vector<std::string> slow;
+    SQLite::ProfilerOptions options;
+    options.slowQueryThreshold = std::chrono::nanoseconds(1);
+    options.onSlowQuery = [&](const SQLite::SlowQuery& query) {
+        slow.push_back(query.expandedSql);
+        throw std::runtime_error("callback failed");
+    };
+    db.enableProfiling(options);
+
+    // long enough to register on a millisecond VFS clock
+    auto statement = db.prepare("INSERT INTO t WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < ?) "
+            "SELECT i FROM n");
+    statement.bind(1, 100000);
+    CHECK(!statement.step());
+    statement.reset();
+    CHECK(!slow.empty());
+    CHECK(slow.front().find("i < 100000") != std::string::npos);
+
+    auto count = db.prepare("SELECT count(*) FROM t");
+    CHECK(count.step());
+    CHECK(count.getInt64(0) == 100000);
+}
+
+int main() {
+    testCounters();
+    testSlowQueryCallback();
+    std::puts("profiler_test passed");
+    return 0;
+}
@@ -0,0 +1,103 @@
+// tests for SQLite::Script, exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+static SQLite openMemory() {
+    return SQLite(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+}
+
+static int64_t count(SQLite& db, const std::string& sql) {
+    auto statement = db.prepare(sql);
+    CHECK(statement.step());
+    return statement.getInt64(0);
+}
+
+// a migration inserts into the table it creates, the INSERT can only be prepared after the CREATE ran
+static void testStatementsUsingTablesCreatedEarlier() {
+    SQLite db = openMemory();
+    SQLite::Script script(db, "CREATE TABLE t(x INTEGER PRIMARY KEY); INSERT INTO t VALUES(1);");
+    CHECK(script.size() == 1);
+    script.execute();
+    CHECK(script.size() == 2);
+    CHECK(script.sql(1) == " INSERT INTO t VALUES(1);");
+    CHECK(count(db, "SELECT count(*) FROM t") == 1);
+}
+
+// the statements prepared by the first run are kept, also across the schema change of a second run
+static void testExecuteTwice() {
+    SQLite db = openMemory();
+    SQLite::Script script(db,
+            "DROP TABLE IF EXISTS t;\n"
+            "CREATE TABLE t(x INTEGER PRIMARY KEY, name TEXT);\n"
+            "INSERT INTO t(name) VALUES(:name);\n"
+            "INSERT INTO t(name) SELECT upper(name) FROM t;\n");
+    script.bind(":name", std::string("a"));
+    script.execute();
+    CHECK(script.size() == 4);
+    CHECK(count(db, "SELECT count(*) FROM t WHERE name IN ('a', 'A')") == 2);
+
+    script.bind(":name", "b");
+    script.execute();
+    CHECK(script.size() == 4);
+    CHECK(count(db, "SELECT count(*) FROM t") == 2);
+    CHECK(count(db, "SELECT count(*) FROM t WHERE name IN ('b', 'B')") == 2);
+}
+
+// rows of every statement reach the callback with the statement's index
+static void testRowsAndNamedParameters() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(x)");
+    SQLite::Script script(db, "INSERT INTO t VALUES(:x); SELECT x FROM t; SELECT :x + 1;");
+    CHECK(script.size() == 3);
+    script.bind(":x", 41);
+    std::vector<std::pair<size_t, int64_t>> rows;
+    script.execute([&](size_t index, SQLite::Statement& statement) { rows.emplace_back(index, statement.getInt64(0)); });
+    CHECK(rows.size() == 2);
+    CHECK(rows[0] == std::make_pair(size_t(1), int64_t(41)));
+    CHECK(rows[1] == std::make_pair(size_t(2), int64_t(42)));
+
+    bool failed = false;
+    try {
+        script.bind(":missing", 1);
+    } catch (const SQLite::OtherError&) {
+        failed = true;
+    }
+    CHECK(failed);
+}
+
+// a statement that still does not compile when reached reports its prepare error
+static void testLatePrepareError() {
+    SQLite db = openMemory();
+    SQLite::Script script(db, "CREATE TABLE t(x); SELECT y FROM t;");
+    bool failed = false;
+    try {
+        script.execute();
+    } catch (const SQLite::Error& e) {
+        failed = true;
+        CHECK(std::string(e.what()).find("no such column") != std::string::npos);
+    }
+    CHECK(failed);
+}
+
+int main() {
+    testStatementsUsingTablesCreatedEarlier();
+    testExecuteTwice();
+    testRowsAndNamedParameters();
+    testLatePrepareError();
+    std::puts("script_test passed");
+    return 0;
+}
@@ -0,0 +1,50 @@
+// regression tests for SQLite::ShardedExecutor, exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+// void functions fan out DDL and DML to every shard
+static void testVoidForEach() {
+    std::vector<std::string> names;
+    for (int i = 0; i < 3; ++i) {
+        names.push_back("file:sharded_test_" + std::to_string(getpid()) + "_" + std::to_string(i) + "?mode=memory&cache=shared");
+    }
+    SQLite::ShardedExecutor executor(names, SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::URI);
+    executor.forEach([](size_t shard, SQLite& db) {
+        db.exec("CREATE TABLE t(shard INTEGER)");
+        db.exec("INSERT INTO t VALUES(" + std::to_string(shard) + ")");
+    });
+    auto counts = executor.forEach([](size_t shard, SQLite& db) {
+        auto statement = db.prepare("SELECT shard FROM t");
+        CHECK(statement.step());
+        return statement.getInt64(0) == static_cast<int64_t>(shard);
+    });
+    CHECK(counts.size() == 3);
+    CHECK(counts[0] && counts[1] && counts[2]);
+
+    bool failed = false;
+    try {
+        executor.forEach([](size_t, SQLite& db) { db.exec("INSERT INTO missing VALUES(1)"); });
+    } catch (const SQLite::Error&) {
+        failed = true;
+    }
+    CHECK(failed);
+}
+
+int main() {
+    testVoidForEach();
+    std::puts("sharded_executor_test passed");
+    return 0;
+}
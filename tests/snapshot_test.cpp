@@ -0,0 +1,121 @@
+// tests for WAL snapshots (SQLITE_ENABLE_SNAPSHOT), exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+static std::string tempPath(const std::string& name) {
+    return "/tmp/sqlite_snapshot_test_" + std::to_string(getpid()) + "_" + name;
+}
+
+static void removeDatabase(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+static int64_t count(SQLite& db) {
+    auto statement = db.prepare("SELECT count(*) FROM t");
+    CHECK(statement.step());
+    return statement.getInt64(0);
+}
+
+static void insert(SQLite::ConnectionPool& pool) {
+    auto writer = pool.acquireWriter();
+    writer->exec("INSERT INTO t VALUES (NULL)");
+}
+
+// frames in the WAL and frames copied by a passive checkpoint
+static std::pair<int64_t, int64_t> checkpoint(SQLite::ConnectionPool& pool) {
+    auto writer = pool.acquireWriter();
+    auto statement = writer->prepare("PRAGMA wal_checkpoint(PASSIVE)");
+    CHECK(statement.step());
+    return {statement.getInt64(1), statement.getInt64(2)};
+}
+
+// two pooled readers opened at a snapshot see the data from before a later write; releasing the leases ends
+// their read transactions, so checkpoints can copy the whole WAL again
+static void testPooledReadersAtSnapshot() {
+    std::string path = tempPath("pool.db");
+    removeDatabase(path);
+    {
+        SQLite::ConnectionPool pool(path, 2);
+        {
+            auto writer = pool.acquireWriter();
+            writer->exec("CREATE TABLE t(x INTEGER PRIMARY KEY)");
+        }
+        insert(pool);
+        SQLite::Snapshot snapshot = pool.takeSnapshot();
+        CHECK(snapshot);
+        insert(pool);
+
+        {
+            auto first = pool.acquireReader(snapshot);
+            auto second = pool.acquireReader(snapshot);
+            CHECK(first->inTransaction());
+            CHECK(second->inTransaction());
+            CHECK(count(*first) == 1);
+            CHECK(count(*second) == 1);
+            insert(pool); // the writer carries on while the readers hold the snapshot
+            CHECK(count(*first) == 1);
+
+            auto frames = checkpoint(pool);
+            CHECK(frames.second < frames.first); // frames after the snapshot stay in the WAL
+        }
+
+        auto reader = pool.acquireReader();
+        CHECK(!reader->inTransaction());
+        CHECK(count(*reader) == 3);
+        reader.release();
+
+        auto frames = checkpoint(pool);
+        CHECK(frames.second == frames.first);
+
+        SQLite::Snapshot latest = pool.takeSnapshot();
+        CHECK(latest.compare(snapshot) > 0);
+    }
+    removeDatabase(path);
+}
+
+// beginTransaction(snapshot) on a connection that has not read the database yet
+static void testTransactionAtSnapshot() {
+    std::string path = tempPath("connection.db");
+    removeDatabase(path);
+    {
+        SQLite::OpenOptions options;
+        options.journalMode = SQLite::JournalMode::WAL;
+        SQLite writer(path, SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create, options);
+        writer.exec("CREATE TABLE t(x INTEGER PRIMARY KEY)");
+        writer.exec("INSERT INTO t VALUES (NULL)");
+        SQLite::Snapshot snapshot = writer.takeSnapshot();
+        CHECK(!writer.inTransaction());
+        writer.exec("INSERT INTO t VALUES (NULL)");
+
+        SQLite reader(path, SQLite::OpenFlags::ReadOnly);
+        {
+            auto transaction = reader.beginTransaction(snapshot);
+            CHECK(count(reader) == 1);
+        }
+        CHECK(!reader.inTransaction());
+        CHECK(count(reader) == 2);
+    }
+    removeDatabase(path);
+}
+
+int main() {
+    testPooledReadersAtSnapshot();
+    testTransactionAtSnapshot();
+    std::puts("snapshot_test passed");
+    return 0;
+}
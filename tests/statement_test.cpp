@@ -0,0 +1,109 @@
+// tests for SQLite::Statement, exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+static SQLite openMemory() {
+    return SQLite(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+}
+
+// a failed bind of an owned buffer must not release the buffer SQLite still points to
+static void testFailedOwnedBindKeepsPreviousBuffer() {
+    SQLite db = openMemory();
+    auto statement = db.prepare("SELECT ?1 UNION ALL SELECT ?1");
+    statement.bind(1, std::string(100, 'a'));
+    CHECK(statement.step());
+
+    bool failed = false;
+    try {
+        statement.bind(1, std::string(100, 'b')); // not reset: SQLITE_MISUSE
+    } catch (const SQLite::Error&) {
+        failed = true;
+    }
+    CHECK(failed);
+    CHECK(statement.step());
+    CHECK(statement.getString(0) == std::string(100, 'a'));
+
+    failed = false;
+    try {
+        statement.bind(1, std::vector<std::byte>(100, std::byte{1}));
+    } catch (const SQLite::Error&) {
+        failed = true;
+    }
+    CHECK(failed);
+    CHECK(!statement.step());
+}
+
+// typed rows decode every column of each remaining row, NULL as an empty optional
+static void testTypedRows() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT, score REAL)");
+    db.exec("INSERT INTO t VALUES (1, 'one', 0.5), (2, NULL, 1.5), (3, 'three', NULL)");
+    auto statement = db.prepare("SELECT id, name, score FROM t ORDER BY id");
+
+    std::vector<std::tuple<int64_t, std::optional<std::string>, std::optional<double>>> rows;
+    for (auto [id, name, score] : statement.rows<int64_t, std::optional<std::string>, std::optional<double>>()) {
+        rows.emplace_back(id, name, score);
+    }
+    CHECK(rows.size() == 3);
+    CHECK(rows[0] == std::make_tuple(int64_t(1), std::optional<std::string>("one"), std::optional<double>(0.5)));
+    CHECK(!std::get<1>(rows[1]) && std::get<2>(rows[1]) == 1.5);
+    CHECK(std::get<1>(rows[2]) == "three" && !std::get<2>(rows[2]));
+
+    statement.reset();
+
+    // fewer columns than the statement returns are fine, more are rejected
+    int64_t sum = 0;
+    for (auto [id] : statement.rows<int64_t>()) {
+        sum += id;
+    }
+    CHECK(sum == 6);
+    bool failed = false;
+    try {
+        statement.rows<int64_t, std::string, double, int>();
+    } catch (const SQLite::OtherError&) {
+        failed = true;
+    }
+    CHECK(failed);
+}
+
+// rowsAs() brace-initializes an aggregate, views stay valid until the next step
+static void testRowsAs() {
+    struct Row {
+        int64_t id;
+        std::string_view name;
+    };
+    SQLite db = openMemory();
+    auto statement = db.prepare("SELECT 1, 'a' UNION ALL SELECT 2, 'bc'");
+    std::string names;
+    int64_t sum = 0;
+    for (const Row& row : statement.rowsAs<Row, int64_t, std::string_view>()) {
+        sum += row.id;
+        names += row.name;
+    }
+    CHECK(sum == 3);
+    CHECK(names == "abc");
+}
+
+int main() {
+    testFailedOwnedBindKeepsPreviousBuffer();
+    testTypedRows();
+    testRowsAs();
+    std::puts("statement_test passed");
+    return 0;
+}
@@ -0,0 +1,119 @@
+// tests for SQLite::TypedStatement, exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+static SQLite openMemory() {
+    return SQLite(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+}
+
+using Insert = SQLite::TypedStatement<SQLite::Params<int64_t, std::optional<std::string>>, SQLite::Columns<>>;
+using Select = SQLite::TypedStatement<SQLite::Params<int64_t>, SQLite::Columns<int64_t, std::string_view>>;
+using Lookup = SQLite::TypedStatement<SQLite::Params<int64_t>, SQLite::Columns<std::optional<std::string>>>;
+
+// execute() rebinds and reruns the same statement, empty optionals bind NULL
+static void testExecute() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+    Insert insert = db.prepareTyped<SQLite::Params<int64_t, std::optional<std::string>>, SQLite::Columns<>>(
+            "INSERT INTO t VALUES (?, ?)");
+    insert.execute(1, std::string("one"));
+    insert.execute(2, std::nullopt);
+    insert.execute(3, std::string("three"));
+
+    Select select(db, "SELECT id, coalesce(name, '-') FROM t WHERE id >= ? ORDER BY id");
+    std::string names;
+    int64_t sum = 0;
+    for (auto [id, name] : select.execute(2)) {
+        sum += id;
+        names += name;
+    }
+    CHECK(sum == 5);
+    CHECK(names == "-three");
+
+    // a new execute() starts over, also before the previous rows were all read
+    auto rows = select.execute(1);
+    CHECK(std::get<0>(*rows.begin()) == 1);
+    sum = 0;
+    for (auto [id, name] : select.execute(1)) {
+        sum += id;
+    }
+    CHECK(sum == 6);
+}
+
+// executeOne() returns the first row or nothing, and resets so the next call sees new data
+static void testExecuteOne() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+    db.exec("INSERT INTO t VALUES (1, 'one'), (2, NULL)");
+    Lookup lookup(db, "SELECT name FROM t WHERE id = ?");
+    auto one = lookup.executeOne(1);
+    CHECK(one && std::get<0>(*one) == "one");
+    auto null = lookup.executeOne(2);
+    CHECK(null && !std::get<0>(*null));
+    CHECK(!lookup.executeOne(3));
+    db.exec("INSERT INTO t VALUES (3, 'three')");
+    auto three = lookup.executeOne(3);
+    CHECK(three && std::get<0>(*three) == "three");
+}
+
+// parameter and column counts are checked once when prepared
+static void testCountsChecked() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+    bool failed = false;
+    try {
+        Select select(db, "SELECT id, name FROM t WHERE id = ? AND name = ?");
+    } catch (const SQLite::OtherError& e) {
+        failed = std::string(e.what()).find("2 parameters, 1 declared") != std::string::npos;
+    }
+    CHECK(failed);
+    failed = false;
+    try {
+        Select select(db, "SELECT id FROM t WHERE id = ?");
+    } catch (const SQLite::OtherError& e) {
+        failed = std::string(e.what()).find("returns 1 columns, 2 declared") != std::string::npos;
+    }
+    CHECK(failed);
+}
+
+// a failing execute() leaves the statement usable
+static void testRecoverAfterError() {
+    SQLite db = openMemory();
+    db.exec("CREATE TABLE t(id INTEGER PRIMARY KEY, name TEXT)");
+    Insert insert(db, "INSERT INTO t VALUES (?, ?)");
+    insert.execute(1, std::string("one"));
+    bool failed = false;
+    try {
+        insert.execute(1, std::string("again"));
+    } catch (const SQLite::Error&) {
+        failed = true;
+    }
+    CHECK(failed);
+    insert.execute(2, std::string("two"));
+    Lookup lookup(db, "SELECT name FROM t WHERE id = ?");
+    auto two = lookup.executeOne(2);
+    CHECK(two && std::get<0>(*two) == "two");
+}
+
+int main() {
+    testExecute();
+    testExecuteOne();
+    testCountsChecked();
+    testRecoverAfterError();
+    std::puts("typed_statement_test passed");
+    return 0;
+}
@@ -0,0 +1,97 @@
+// tests for SQLite::createVirtualTable, exits non-zero on the first failed check
+
+#include "sqlite.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
+
+struct Item {
+    int64_t id;
+    std::string name;
+};
+
+static SQLite openMemory() {
+    return SQLite(":memory:", SQLite::OpenFlags::ReadWrite | SQLite::OpenFlags::Create | SQLite::OpenFlags::Memory);
+}
+
+static std::string ids(SQLite& db, const std::string& sql) {
+    auto statement = db.prepare("SELECT group_concat(id, ',') FROM (" + sql + ")");
+    CHECK(statement.step());
+    return statement.getString(0);
+}
+
+static std::string plan(SQLite& db, const std::string& sql) {
+    auto statement = db.prepare("EXPLAIN QUERY PLAN " + sql);
+    std::string details;
+    while (statement.step()) {
+        details += statement.getString(3);
+    }
+    return details;
+}
+
+// sorted by id and, in BINARY order, by name
+static const std::vector<Item> items = {{1, "ABC"}, {2, "Abc"}, {3, "abc"}, {4, "b"}, {5, "c"}};
+
+static void createItems(SQLite& db) {
+    db.createVirtualTable("items", items, {
+        SQLite::virtualColumn<Item>("id", &Item::id, SQLite::VirtualKey::Sorted),
+        SQLite::virtualColumn<Item>("name", &Item::name, SQLite::VirtualKey::Sorted),
+    });
+}
+
+// equality and ranges on a sorted key are binary searches that return exactly the matching rows
+static void testSortedLookups() {
+    SQLite db = openMemory();
+    createItems(db);
+    CHECK(ids(db, "SELECT id FROM items") == "1,2,3,4,5");
+    CHECK(ids(db, "SELECT id FROM items WHERE id = 3") == "3");
+    CHECK(ids(db, "SELECT id FROM items WHERE id BETWEEN 2 AND 4") == "2,3,4");
+    CHECK(ids(db, "SELECT id FROM items WHERE id > 4") == "5");
+    CHECK(ids(db, "SELECT id FROM items WHERE id < 1").empty());
+    CHECK(ids(db, "SELECT id FROM items WHERE name = 'abc'") == "3");
+    CHECK(ids(db, "SELECT id FROM items WHERE name >= 'b'") == "4,5");
+    CHECK(plan(db, "SELECT id FROM items WHERE id = 3").find("INDEX 1:e") != std::string::npos);
+}
+
+// NOCASE constraints are left to SQLite, the key's BINARY range would drop 'ABC' and 'Abc'
+static void testNocaseConstraints() {
+    SQLite db = openMemory();
+    createItems(db);
+    CHECK(ids(db, "SELECT id FROM items WHERE name = 'abc' COLLATE NOCASE") == "1,2,3");
+    CHECK(ids(db, "SELECT id FROM items WHERE name >= 'B' COLLATE NOCASE") == "4,5");
+    CHECK(ids(db, "SELECT id FROM items WHERE name < 'b' COLLATE NOCASE") == "1,2,3");
+    CHECK(plan(db, "SELECT id FROM items WHERE name = 'abc' COLLATE NOCASE").find("INDEX 0:") != std::string::npos);
+}
+
+// a Lookup key uses the map's equal_range(), also only for BINARY constraints
+static void testMapLookup() {
+    using Entry = std::map<std::string, int64_t>::value_type;
+    std::map<std::string, int64_t> names = {{"ABC", 1}, {"abc", 2}, {"b", 3}};
+    SQLite db = openMemory();
+    db.createVirtualTable("names", names, {
+        SQLite::virtualColumn<Entry>("name", [](const Entry& entry) { return entry.first; }, SQLite::VirtualKey::Lookup),
+        SQLite::virtualColumn<Entry>("id", [](const Entry& entry) { return entry.second; }),
+    });
+    CHECK(ids(db, "SELECT id FROM names WHERE name = 'abc'") == "2");
+    CHECK(ids(db, "SELECT id FROM names WHERE name = 'missing'").empty());
+    CHECK(ids(db, "SELECT id FROM names WHERE name = 'abc' COLLATE NOCASE") == "1,2");
+}
+
+int main() {
+    testSortedLookups();
+    testNocaseConstraints();
+    testMapLookup();
+    std::puts("virtual_table_test passed");
+    return 0;
+}